@@ -52,20 +52,56 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes: 8, 16, 32 or 64. mm.c lays out its
+ * blocks for it and mdriver checks every payload against it; set it
+ * from the command line with make CFLAGS="... -DALIGNMENT=16"
  */
+#ifndef ALIGNMENT
 #define ALIGNMENT 8  
+#endif
 
 /* 
- * Maximum heap size in bytes 
+ * Default maximum heap size in bytes; mdriver -H sets another.
+ * memlib reserves this much address space up front but commits it
+ * MEM_COMMIT bytes at a time as the heap grows.
  */
 #define MAX_HEAP (200*(1<<20))  /* 200 MB */
 
+/*
+ * Set MEM_THP to 1 to ask for transparent huge pages behind the heap.
+ * The reservation is then 2 MB aligned and committed in 2 MB steps.
+ */
+#ifndef MEM_THP
+#define MEM_THP 0
+#endif
+
+#if MEM_THP
+#define MEM_COMMIT (1<<21)      /* 2 MB, one huge page */
+#else
+#define MEM_COMMIT (1<<16)      /* 64 KB */
+#endif
+
+/*
+ * Size of the region memlib hands out mappings from (mem_map)
+ */
+#define MAX_MAP (200*(1<<20))   /* 200 MB */
+
+/*
+ * Set MM_EVENTS to 1 to build the allocator's event counters and heap
+ * snapshots, and with them the driver's fragmentation timeline (-F).
+ * At 0 the hooks in mm.c compile away to nothing. It can also be set
+ * from the command line: make clean; make CFLAGS="... -DMM_EVENTS=1"
+ */
+#ifndef MM_EVENTS
+#define MM_EVENTS 0
+#endif
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
 #define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_PERF   0   /* gettimeofday plus hardware event counts (Linux) */
 
 #endif /* __CONFIG_H */
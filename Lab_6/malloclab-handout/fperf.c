@@ -0,0 +1,134 @@
+/*
+ * fperf.c - Estimate the time (in seconds) used by a function f, and
+ *     count the hardware events of its runs
+ *
+ * The events are counted with the Linux perf_event_open system call,
+ * for this process in user mode only, so that the default setting of
+ * kernel.perf_event_paranoid allows them. Every event has a counter of
+ * its own: an event the CPU, a virtual machine or the kernel does not
+ * offer is simply left out, and with none at all (or on another OS)
+ * fperf is just ftimer_gettod.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "fperf.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define CACHE_EVENT(cache, result) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | ((result) << 16))
+
+/* What perf_event_open calls each of the events of fperf.h */
+static const struct {
+    unsigned type;
+    unsigned long long config;
+} events[FPERF_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+#endif
+
+static const char *names[FPERF_EVENTS] = {
+    "cycles", "instructions", "L1D misses", "LLC misses", "dTLB misses",
+    "branch misses"
+};
+
+static int fds[FPERF_EVENTS];  /* counter of each event, or -1 */
+static int opened;             /* have the counters been opened? */
+
+/*
+ * fperf_init - Open a counter for every event we are allowed to count
+ */
+int fperf_init(void)
+{
+    int e, n = 0;
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    for (e = 0; e < FPERF_EVENTS; e++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[e].type;
+	attr.config = events[e].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	/* with more events than counters the kernel takes turns, so
+	   keep the times to scale the counts by */
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fds[e] >= 0)
+	    n++;
+    }
+#else
+    for (e = 0; e < FPERF_EVENTS; e++)
+	fds[e] = -1;
+#endif
+    opened = 1;
+    return n;
+}
+
+/*
+ * fperf_name - Short name of event e
+ */
+const char *fperf_name(int e)
+{
+    return names[e];
+}
+
+/*
+ * fperf - Use gettimeofday to estimate the running time of f(argp),
+ * and count the events of the runs. Return the average of n runs.
+ */
+double fperf(fperf_test_funct f, void *argp, int n, fperf_counts_t *counts)
+{
+    int e, i;
+    struct timeval stv, etv;
+    double diff;
+#ifdef __linux__
+    unsigned long long value[3]; /* count, time enabled, time running */
+#endif
+
+    if (!opened)
+	fperf_init();
+    memset(counts, 0, sizeof(*counts));
+
+#ifdef __linux__
+    for (e = 0; e < FPERF_EVENTS; e++)
+	if (fds[e] >= 0) {
+	    ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+    gettimeofday(&stv, NULL);
+    for (i = 0; i < n; i++)
+	f(argp);
+    gettimeofday(&etv,NULL);
+#ifdef __linux__
+    for (e = 0; e < FPERF_EVENTS; e++)
+	if (fds[e] >= 0)
+	    ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (e = 0; e < FPERF_EVENTS; e++) {
+	if (fds[e] < 0 || read(fds[e], value, sizeof(value)) != sizeof(value) ||
+	    value[2] == 0)
+	    continue;
+	counts->valid[e] = 1;
+	counts->count[e] = (double)value[0] * value[1] / value[2] / n;
+    }
+#endif
+
+    diff = 1E3*(etv.tv_sec - stv.tv_sec) + 1E-3*(etv.tv_usec-stv.tv_usec);
+    diff /= n;
+    return (1E-3*diff);
+}
@@ -0,0 +1,37 @@
+/*
+ * Function timer with hardware event counts (Linux perf_event_open)
+ */
+#ifndef __FPERF_H_
+#define __FPERF_H_
+
+typedef void (*fperf_test_funct)(void *);
+
+/* The events counted, in the order of fperf_counts_t.count */
+enum {
+    FPERF_CYCLES,        /* CPU cycles */
+    FPERF_INSTRUCTIONS,  /* instructions retired */
+    FPERF_L1D_MISSES,    /* L1 data cache read misses */
+    FPERF_LLC_MISSES,    /* last level cache misses */
+    FPERF_DTLB_MISSES,   /* data TLB read misses */
+    FPERF_BRANCH_MISSES, /* mispredicted branches */
+    FPERF_EVENTS
+};
+
+/* Event counts of one run of a function */
+typedef struct {
+    int valid[FPERF_EVENTS];     /* was the event counted? */
+    double count[FPERF_EVENTS];  /* its count, averaged over the runs */
+} fperf_counts_t;
+
+/* Open a counter for every event the machine and kernel allow.
+   Return how many could be opened */
+int fperf_init(void);
+
+/* Short name of event e */
+const char *fperf_name(int e);
+
+/* Estimate the running time of f(argp) using gettimeofday, and count
+   the events of the runs into *counts. Return the average of n runs */
+double fperf(fperf_test_funct f, void *argp, int n, fperf_counts_t *counts);
+
+#endif /* __FPERF_H_ */
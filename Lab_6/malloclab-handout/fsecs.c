@@ -6,9 +6,12 @@
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "fperf.h"
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static fperf_counts_t counts; /* event counts of the last fsecs() run */
+static int ncounters;         /* events we are able to count */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -36,6 +39,13 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_PERF
+    ncounters = fperf_init();
+    if (verbose && ncounters > 0)
+	printf("Measuring performance with gettimeofday() and %d hardware counters.\n",
+	       ncounters);
+    else if (verbose)
+	printf("Measuring performance with gettimeofday(); no hardware counters available.\n");
 #endif
 }
 
@@ -51,7 +61,22 @@ double fsecs(fsecs_test_funct f, void *argp)
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
     return ftimer_gettod(f, argp, 10);
+#elif USE_PERF
+    return fperf(f, argp, 10, &counts);
 #endif 
 }
 
+/*
+ * fsecs_counters - Return the event counts of the last fsecs() run
+ */
+int fsecs_counters(fperf_counts_t *c)
+{
+    int e, n = 0;
+
+    *c = counts;
+    for (e = 0; e < FPERF_EVENTS; e++)
+	n += c->valid[e];
+    return ncounters > 0 && n > 0;
+}
+
 
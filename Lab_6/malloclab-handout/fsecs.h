@@ -1,4 +1,10 @@
+#include "fperf.h"
+
 typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+
+/* Copy the event counts of the last fsecs() run to *counts; 0 if it
+   counted none (other timing methods, or no counters available) */
+int fsecs_counters(fperf_counts_t *counts);
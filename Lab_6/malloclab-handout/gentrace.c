@@ -0,0 +1,344 @@
+/*
+ * gentrace.c - Generate synthetic malloc traces from parameterized
+ *     workload models, as .rep text or in the binary format of trace.h
+ *
+ * A trace is a random walk of allocations and frees that climbs to a
+ * target peak of live payload bytes and then hovers below it. Request
+ * sizes and block lifetimes each come from a selectable model, and a
+ * realloc growth chain can be interleaved with the other requests.
+ * Every live block is freed at the end, so traces are balanced like
+ * the -bal traces. The same seed always gives the same trace.
+ *
+ * The generator keeps only the live blocks in memory and writes each
+ * request as it goes, so traces far larger than RAM can be made; the
+ * header counts are patched in at the end.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+
+#include "trace.h"
+
+/* Size distributions */
+typedef enum {UNIFORM, POWERLAW, BIMODAL, CLASSES} SizeModel;
+static const char *size_models[] = {"uniform", "powerlaw", "bimodal", "classes", NULL};
+
+/* Lifetime distributions: which live block the next free picks */
+typedef enum {LIFO, FIFO, RANDOM, MIXED} LifeModel;
+static const char *life_models[] = {"lifo", "fifo", "random", "mixed", NULL};
+
+/* A live block */
+typedef struct {
+    int id;
+    int size;
+} block_t;
+
+/* A pool of live blocks; FIFO pools are consumed from first upward */
+typedef struct {
+    block_t *b;
+    long first, n, cap;
+} pool_t;
+
+/* Generator parameters */
+static long num_reqs = 100000;     /* requests to emit, final frees included */
+static unsigned long long seed = 1;
+static SizeModel size_model = POWERLAW;
+static int min_size = 8;
+static int max_size = 4096;
+static double alpha = 1.5;         /* power-law tail exponent */
+static LifeModel life_model = RANDOM;
+static double long_frac = 0.1;     /* share of long-lived blocks (mixed) */
+static double realloc_prob = 0;    /* chance a request grows the realloc chain */
+static double growth = 1.5;        /* size factor per chain realloc */
+static long peak_bytes = 1 << 20;  /* target peak of live payload bytes */
+static int binary = 0;             /* write the binary format */
+
+static FILE *out;
+static long num_ops = 0;           /* requests written so far */
+static int num_ids = 0;            /* ids handed out so far */
+static long live_bytes = 0;
+
+/*
+ * rnd - xorshift64*, so traces do not depend on the C library's rand()
+ */
+static unsigned long long rnd(void)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 2685821657736338717ULL;
+}
+
+/* Uniform double in [0, 1) and integer in [lo, hi] */
+static double urand(void) { return (rnd() >> 11) * (1.0 / 9007199254740992.0); }
+static int irand(int lo, int hi) { return lo + (int)(urand() * (hi - lo + 1)); }
+
+/*
+ * draw_size - Payload size of the next allocation
+ */
+static int draw_size(void)
+{
+    int lo, hi;
+    double v;
+
+    switch (size_model) {
+    case UNIFORM:
+	return irand(min_size, max_size);
+    case POWERLAW:
+	/* Pareto: most requests near min_size, a long tail up to max_size */
+	v = min_size / pow(1.0 - urand(), 1.0 / alpha);
+	return v > max_size ? max_size : (int)v;
+    case BIMODAL:
+	/* 90% small objects, 10% large buffers */
+	if (urand() < 0.9)
+	    return irand(min_size, 4 * min_size < max_size ? 4 * min_size : max_size);
+	return irand(max_size / 2 > min_size ? max_size / 2 : min_size, max_size);
+    case CLASSES:
+	/* exact powers of two, uniform in log2 between min and max */
+	lo = 31 - __builtin_clz(min_size);
+	hi = 31 - __builtin_clz(max_size);
+	return 1 << irand(lo, hi);
+    }
+    return min_size;
+}
+
+/*
+ * Pools of live blocks
+ */
+static void pool_push(pool_t *p, int id, int size)
+{
+    if (p->first + p->n == p->cap) {
+	if (p->first > p->n) {
+	    /* FIFO: slide the live part down instead of growing */
+	    memmove(p->b, p->b + p->first, p->n * sizeof(block_t));
+	    p->first = 0;
+	}
+	else {
+	    p->cap = p->cap ? 2 * p->cap : 1024;
+	    if ((p->b = (block_t *)realloc(p->b, p->cap * sizeof(block_t))) == NULL) {
+		fprintf(stderr, "gentrace: out of memory\n");
+		exit(1);
+	    }
+	}
+    }
+    p->b[p->first + p->n].id = id;
+    p->b[p->first + p->n].size = size;
+    p->n++;
+}
+
+/* Index (relative to first) of the block the lifetime model frees next */
+static long pool_pick(pool_t *p)
+{
+    switch (life_model) {
+    case LIFO:
+	return p->n - 1;
+    case FIFO:
+	return 0;
+    default:
+	return (long)(urand() * p->n);
+    }
+}
+
+static block_t pool_take(pool_t *p, long i)
+{
+    block_t b = p->b[p->first + i];
+
+    if (i == 0 && life_model == FIFO) {
+	p->first++;
+    }
+    else {
+	p->b[p->first + i] = p->b[p->first + p->n - 1];
+    }
+    p->n--;
+    return b;
+}
+
+/*
+ * Emit one request
+ */
+static void emit(RequestType type, int id, int size)
+{
+    traceop_t op;
+
+    if (binary) {
+	op.type = type;
+	op.index = id;
+	op.size = size;
+	fwrite(&op, sizeof(op), 1, out);
+    }
+    else if (type == FREE)
+	fprintf(out, "f %d\n", id);
+    else
+	fprintf(out, "%c %d %d\n", type == ALLOC ? 'a' : 'r', id, size);
+    num_ops++;
+}
+
+/*
+ * write_header - Write the header; called once with placeholders and
+ *     again at the end with the real counts. Text headers are padded
+ *     to a fixed width so the rewrite fits exactly.
+ */
+static void write_header(void)
+{
+    bintrace_hdr_t hdr;
+
+    rewind(out);
+    if (binary) {
+	memset(&hdr, 0, sizeof(hdr));
+	strncpy(hdr.magic, BINTRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = BINTRACE_VERSION;
+	hdr.sugg_heapsize = peak_bytes;
+	hdr.num_ids = num_ids;
+	hdr.num_ops = num_ops;
+	hdr.weight = 1;
+	fwrite(&hdr, sizeof(hdr), 1, out);
+    }
+    else
+	fprintf(out, "%-10ld\n%-10d\n%-10ld\n%-10d\n", peak_bytes, num_ids, num_ops, 1);
+}
+
+static int lookup(const char **names, const char *s, const char *what)
+{
+    int i;
+
+    for (i = 0; names[i] != NULL; i++)
+	if (!strcmp(names[i], s))
+	    return i;
+    fprintf(stderr, "gentrace: unknown %s model %s\n", what, s);
+    exit(1);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: gentrace [-B] [-n <ops>] [-S <seed>] [-d <sizes>] [-m <min>] [-M <max>]\n"
+	    "                [-a <alpha>] [-l <lifetimes>] [-f <frac>] [-r <prob>] [-g <factor>]\n"
+	    "                [-p <bytes>] -o <file>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-a <alpha>   Power-law tail exponent (1.5).\n");
+    fprintf(stderr, "\t-B           Write the binary trace format.\n");
+    fprintf(stderr, "\t-d <sizes>   uniform, powerlaw, bimodal or classes (powerlaw).\n");
+    fprintf(stderr, "\t-f <frac>    Share of long-lived blocks with -l mixed (0.1).\n");
+    fprintf(stderr, "\t-g <factor>  Growth of each realloc in a chain (1.5).\n");
+    fprintf(stderr, "\t-l <life>    lifo, fifo, random or mixed (random).\n");
+    fprintf(stderr, "\t-m <min>     Smallest request (8).\n");
+    fprintf(stderr, "\t-M <max>     Largest request (4096).\n");
+    fprintf(stderr, "\t-n <ops>     Number of requests (100000).\n");
+    fprintf(stderr, "\t-o <file>    Output trace.\n");
+    fprintf(stderr, "\t-p <bytes>   Target peak live payload (1048576).\n");
+    fprintf(stderr, "\t-r <prob>    Chance a request grows the realloc chain (0).\n");
+    fprintf(stderr, "\t-S <seed>    Random seed (1).\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    pool_t pools[2] = {{0}, {0}};   /* short-lived, long-lived (mixed only) */
+    pool_t *p;
+    block_t b;
+    char *outfile = NULL;
+    int c, size, chain = -1, chain_size = 0, climbing = 1;
+    long i, left;
+
+    while ((c = getopt(argc, argv, "Bn:S:d:m:M:a:l:f:r:g:p:o:h")) != EOF) {
+	switch (c) {
+	case 'B': binary = 1; break;
+	case 'n': num_reqs = atol(optarg); break;
+	case 'S': seed = strtoull(optarg, NULL, 0); break;
+	case 'd': size_model = lookup(size_models, optarg, "size"); break;
+	case 'm': min_size = atoi(optarg); break;
+	case 'M': max_size = atoi(optarg); break;
+	case 'a': alpha = atof(optarg); break;
+	case 'l': life_model = lookup(life_models, optarg, "lifetime"); break;
+	case 'f': long_frac = atof(optarg); break;
+	case 'r': realloc_prob = atof(optarg); break;
+	case 'g': growth = atof(optarg); break;
+	case 'p': peak_bytes = atol(optarg); break;
+	case 'o': outfile = optarg; break;
+	default: usage();
+	}
+    }
+    if (outfile == NULL || min_size < 1 || max_size < min_size || alpha <= 0 || growth <= 1)
+	usage();
+    if (seed == 0)
+	seed = 1; /* xorshift never leaves 0 */
+    if ((out = fopen(outfile, "w")) == NULL) {
+	fprintf(stderr, "gentrace: could not create %s: %s\n", outfile, strerror(errno));
+	exit(1);
+    }
+    write_header();
+
+    /*
+     * Leave room for freeing whatever is still live at the end; a new
+     * block costs two requests, so with one left only a realloc or a
+     * free fits, and with neither possible the trace ends one short
+     */
+    while ((left = num_reqs - num_ops - pools[0].n - pools[1].n - (chain >= 0)) > 0) {
+	if (left == 1 && chain < 0 && pools[0].n + pools[1].n == 0)
+	    break;
+
+	/* Grow the realloc chain block, or start a new chain */
+	if (realloc_prob > 0 && (left == 1 ? chain >= 0 : urand() < realloc_prob)) {
+	    if (left > 1 && chain >= 0 && chain_size > 16 * max_size) {
+		/* a finished chain becomes an ordinary short-lived block */
+		pool_push(&pools[0], chain, chain_size);
+		chain = -1;
+		continue;
+	    }
+	    if (chain < 0) {
+		chain = num_ids++;
+		chain_size = draw_size();
+		emit(ALLOC, chain, chain_size);
+		live_bytes += chain_size;
+	    }
+	    else {
+		size = (int)(chain_size * growth) + 1;
+		emit(REALLOC, chain, size);
+		live_bytes += size - chain_size;
+		chain_size = size;
+	    }
+	    continue;
+	}
+
+	/* Climb to the peak, then hover below it */
+	size = draw_size();
+	if (live_bytes + size > peak_bytes)
+	    climbing = 0;
+	if (pools[0].n + pools[1].n == 0 ||
+	    (left > 1 && live_bytes + size <= peak_bytes && urand() < (climbing ? 0.6 : 0.5))) {
+	    p = &pools[life_model == MIXED && urand() < long_frac];
+	    pool_push(p, num_ids, size);
+	    emit(ALLOC, num_ids++, size);
+	    live_bytes += size;
+	}
+	else {
+	    /* long-lived blocks are only rarely freed before the end */
+	    p = &pools[0];
+	    if (p->n == 0 || (pools[1].n > 0 && urand() < 0.02))
+		p = &pools[1];
+	    b = pool_take(p, pool_pick(p));
+	    emit(FREE, b.id, 0);
+	    live_bytes -= b.size;
+	}
+    }
+
+    /* Free everything still live, in the order the lifetime model says */
+    if (chain >= 0)
+	emit(FREE, chain, 0);
+    for (i = 0; i < 2; i++)
+	while (pools[i].n > 0) {
+	    b = pool_take(&pools[i], pool_pick(&pools[i]));
+	    emit(FREE, b.id, 0);
+	}
+
+    write_header();
+    if (fclose(out) != 0) {
+	fprintf(stderr, "gentrace: could not write %s: %s\n", outfile, strerror(errno));
+	exit(1);
+    }
+    free(pools[0].b);
+    free(pools[1].b);
+    return 0;
+}
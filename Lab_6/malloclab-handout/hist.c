@@ -0,0 +1,110 @@
+/*
+ * hist.c - Log-bucketed histograms for per-operation latencies
+ *
+ * Bucket b < 2^HIST_SUB_BITS holds exactly the value b. Above that a
+ * value v with leading one at bit e lands in power-of-two group
+ * e - HIST_SUB_BITS + 1, at the sub-bucket given by the HIST_SUB_BITS
+ * bits just below the leading one. Adding a value is a count-leading-
+ * zeros and two shifts, cheap enough to do around every malloc.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "hist.h"
+
+#define SUB_COUNT (1 << HIST_SUB_BITS)
+
+/*
+ * bucket_of - Index of the bucket that counts value v
+ */
+static int bucket_of(unsigned long long v)
+{
+    int e;
+
+    if (v < SUB_COUNT)
+	return (int)v;
+    e = 63 - __builtin_clzll(v);
+    return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+	(int)((v >> (e - HIST_SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+/*
+ * hist_reset - Empty the histogram
+ */
+void hist_reset(hist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/*
+ * hist_add - Count one value
+ */
+void hist_add(hist_t *h, unsigned long long v)
+{
+    h->count[bucket_of(v)]++;
+    h->n++;
+    h->sum += v;
+    if (v > h->max)
+	h->max = v;
+}
+
+/*
+ * hist_bucket_lo - Lowest value that falls in bucket b
+ */
+unsigned long long hist_bucket_lo(int b)
+{
+    int group = b >> HIST_SUB_BITS;
+    int e = group + HIST_SUB_BITS - 1;
+
+    if (group == 0)
+	return b;
+    return (1ULL << e) + ((unsigned long long)(b & (SUB_COUNT - 1)) << (e - HIST_SUB_BITS));
+}
+
+/*
+ * hist_bucket_hi - Highest value that falls in bucket b
+ */
+unsigned long long hist_bucket_hi(int b)
+{
+    if (b == HIST_BUCKETS - 1)
+	return ~0ULL;
+    return hist_bucket_lo(b + 1) - 1;
+}
+
+/*
+ * hist_percentile - Upper bound of the bucket holding the value at
+ *     fraction q (0 < q <= 1) of the sorted values, capped by the
+ *     largest value actually seen
+ */
+unsigned long long hist_percentile(hist_t *h, double q)
+{
+    unsigned long rank, seen = 0;
+    unsigned long long hi;
+    int b;
+
+    if (h->n == 0)
+	return 0;
+    rank = (unsigned long)(q * h->n + 0.5);
+    if (rank < 1)
+	rank = 1;
+    for (b = 0; b < HIST_BUCKETS; b++) {
+	seen += h->count[b];
+	if (seen >= rank) {
+	    hi = hist_bucket_hi(b);
+	    return hi < h->max ? hi : h->max;
+	}
+    }
+    return h->max;
+}
+
+/*
+ * hist_write_csv - Write each non-empty bucket as "prefix,lo,hi,count"
+ */
+void hist_write_csv(hist_t *h, FILE *fp, const char *prefix)
+{
+    int b;
+
+    for (b = 0; b < HIST_BUCKETS; b++)
+	if (h->count[b])
+	    fprintf(fp, "%s,%llu,%llu,%lu\n", prefix,
+		    hist_bucket_lo(b), hist_bucket_hi(b), h->count[b]);
+}
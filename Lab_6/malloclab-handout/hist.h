@@ -0,0 +1,35 @@
+/*
+ * hist.h - prototypes for the log-bucketed latency histograms in hist.c
+ *
+ * Values are counted in buckets whose width grows with their magnitude
+ * (HDR histogram style): below 2^HIST_SUB_BITS every value has its own
+ * bucket, above it each power of two is split into 2^HIST_SUB_BITS
+ * equal buckets, so any recorded value is off by at most 1/16.
+ */
+#include <stdio.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+typedef struct {
+    unsigned long count[HIST_BUCKETS]; /* values that fell in each bucket */
+    unsigned long n;                   /* total number of values */
+    double sum;                        /* sum of all values, for the mean */
+    unsigned long long max;            /* largest value seen */
+} hist_t;
+
+/* Empty the histogram */
+void hist_reset(hist_t *h);
+
+/* Count one value */
+void hist_add(hist_t *h, unsigned long long v);
+
+/* Smallest bucket bound that at least fraction q of the values are at or below */
+unsigned long long hist_percentile(hist_t *h, double q);
+
+/* Lowest and highest value that fall in bucket b */
+unsigned long long hist_bucket_lo(int b);
+unsigned long long hist_bucket_hi(int b);
+
+/* Write each non-empty bucket as "prefix,lo,hi,count" */
+void hist_write_csv(hist_t *h, FILE *fp, const char *prefix);
@@ -15,10 +15,19 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
+#include "hist.h"
+#include "profile.h"
+#include "class_table.h"
+#include "trace.h"
 #include "config.h"
 
 /**********************
@@ -30,6 +39,26 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Multithreaded replay (-T) */
+#define MAXTHREADS    64 /* most threads -T will start */
+#define THREAD_REPS    3 /* timed runs per thread count, the fastest is kept */
+
+/* Streaming replay (-s) */
+#define STREAM_BATCH 4096 /* requests per batch */
+#define STREAM_RING     8 /* batches in flight between reader and replay */
+
+/* Resident footprint */
+#define RESIDENT_EVERY 100 /* requests between samples of the resident heap */
+
+/* Fragmentation timeline (-F) */
+#define TIMELINE_EVERY 100 /* default requests between snapshots (-I) */
+
+/* Size class lookups (-S) */
+#define LOOKUP_MIN (1<<22) /* lookups timed per method and trace, at least */
+
+/* Validity checks through mm_memalign (-M) */
+#define MEMALIGN_MAX 4096 /* largest alignment asked for */
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
@@ -37,21 +66,19 @@
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/*
+ * Records the extent of each block's payload. The ranges of a trace
+ * form a treap: a binary search tree on lo that is also a heap on a
+ * random priority, which keeps it balanced in expectation.
+ */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    unsigned prio;         /* random heap priority */
+    struct range_t *left;  /* ranges with a lower lo */
+    struct range_t *right; /* ranges with a higher lo; next free node in the pool */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef enum {ALLOC, FREE, REALLOC} RequestType;
-typedef struct {
-    RequestType type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
 /* Holds the information for one trace file*/
 typedef struct {
     int sugg_heapsize;   /* suggested heap size (unused) */
@@ -61,6 +88,8 @@ typedef struct {
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapping of a binary trace that ops points into */
+    size_t map_len;      /*   and its length, or NULL and 0 for a .rep */
 } trace_t;
 
 /* 
@@ -73,19 +102,75 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Heap footprint of mm.c over one trace, in bytes */
+typedef struct {
+    double heap_peak;  /* high water mark of the brk */
+    double heap_end;   /* brk after the last request */
+    double map_peak;   /* high water mark of the brk plus mem_map'd bytes */
+    double rss_peak;   /* most heap bytes resident in RAM at any sample */
+    double rss_end;    /* heap bytes resident after the last request */
+    unsigned long payloads; /* payloads mm_malloc and mm_realloc returned */
+    unsigned long split;    /*   and those spanning more cache lines than needed */
+    unsigned long small_split; /*   and those of them no bigger than a line */
+} footprint_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    int has_hw;      /* were hardware events counted during the timing? */
+    fperf_counts_t hw; /*   and their counts per run of the trace */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    mm_fitstats_t fit; /* find_fit probe counts during the utilization run */
+    footprint_t mem;   /* heap size and resident bytes during that run */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* One thread's share of a multithreaded replay (-T) */
+typedef struct {
+    trace_t *trace;          /* trace to replay, shared read-only */
+    char **blocks;           /* this thread's own block pointers */
+    int use_libc;            /* replay against libc instead of mm.c */
+    pthread_barrier_t *start;/* released once every thread is ready */
+    double t0, t1;           /* when this thread started and finished */
+} thread_arg_t;
+
+/* A batch of requests passed from the reader thread to the replay (-s) */
+typedef struct {
+    int n;                         /* requests in ops, 0 marks the end */
+    traceop_t ops[STREAM_BATCH];
+} batch_t;
+
+/* 
+ * A trace being streamed (-s). The reader thread fills ring slots
+ * head % STREAM_RING while the replay drains slots tail % STREAM_RING;
+ * head and tail only ever grow and are guarded by lock.
+ */
+typedef struct {
+    FILE *fp;                      /* the open trace, past its header */
+    int binary;                    /* fp holds traceop_t records, not text */
+    char *path;                    /* for error messages */
+    batch_t ring[STREAM_RING];
+    long head;                     /* batches filled by the reader */
+    long tail;                     /* batches consumed by the replay */
+    pthread_mutex_t lock;
+    pthread_cond_t not_full;       /* signaled when tail moves */
+    pthread_cond_t not_empty;      /* signaled when head moves */
+} stream_t;
+
+/* Scaling results for one package on one trace */
+typedef struct {
+    double kops1;            /* throughput of a single thread */
+    double kopsn;            /* aggregate throughput of nthreads threads */
+    double usecs;            /* mean per-op latency seen by each thread */
+    double maxusecs;         /* per-op latency of the slowest thread */
+} scale_t;
+
 /********************
  * Global variables
  *******************/
@@ -96,6 +181,20 @@ char msg[MAXLINE];      /* for whenever we need to compose an error message */
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* Names of the request types, indexed by RequestType */
+static const char *request_names[NUM_REQUEST_TYPES] = {
+    "malloc", "free", "realloc"
+};
+
+/* Names of the placement policies, indexed by MM_FIT_xxx (-p) */
+static const char *fit_names[MM_NUM_FITS] = {
+    "first", "next", "best", "good", "seg"
+};
+static int fit_policy = MM_FIT_SEG; /* placement policy chosen with -p */
+static int check_every = 0;         /* full mm_checkheap every this many requests (-c) */
+static int memalign_test = 0;       /* validity runs allocate with mm_memalign (-M) */
+static int line_test = 0;           /*   or with mm_malloc_flags (-X) */
+
 /* The filenames of the default tracefiles */
 static const char *default_tracefiles[] = {  
     DEFAULT_TRACEFILES, NULL
@@ -106,14 +205,19 @@ static const char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate range trees */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *insert_range(range_t *root, range_t *node);
+static range_t *delete_range(range_t *root, char *lo);
+static range_t *new_range(void);
+static void free_range(range_t *p);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static int map_bintrace(trace_t *trace, char *path);
 static void free_trace(trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
@@ -123,11 +227,49 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static size_t next_align(int opnum);
+static int check_lines(char *p, int size, int flags, int tracenum, int opnum);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   footprint_t *mem);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, hist_t *hists);
+static void eval_class_lookup(trace_t *trace, double cycles[3]);
+
+/* Routines for replaying a trace without loading it (-s) */
+static void eval_mm_stream(char *tracedir, char *filename, stats_t *stats);
+static void *stream_reader(void *ptr);
+static int read_ops(stream_t *st, traceop_t *ops, int max);
+
+/* Routines for measuring how mm.c and libc scale with threads (-T) */
+static void eval_scaling(trace_t *trace, int nthreads, int use_libc, scale_t *sc);
+static double eval_threads(trace_t *trace, int nthreads, int use_libc,
+			   double *thread_secs);
+static void *replay_thread(void *ptr);
+static void printscaling(int n, int nthreads, scale_t *mm, scale_t *libc);
+
+/* Routines for comparing placement policies (-p) */
+static int lookup_fit(const char *name);
+static void eval_policies(int n, char **tracefiles);
+static void printfit(int n, stats_t *stats);
+static void printpolicies(int n, stats_t (*stats)[MM_NUM_FITS]);
+
+/* Routines for reporting per-operation latency (-L, -C) */
+static void printlatency(int n, hist_t (*lat)[NUM_REQUEST_TYPES]);
+static void write_latency_csv(char *csvfile, int n, char **tracefiles,
+			      hist_t (*lat)[NUM_REQUEST_TYPES]);
+static double wall_secs(void);
+
+/* Fragmentation timeline; needs mm.c built with MM_EVENTS (-F, -I) */
+#if MM_EVENTS
+static void eval_mm_timeline(trace_t *trace, int tracenum, FILE *fp, int every);
+static void write_snapshot(FILE *fp, int tracenum, int opnum, long live_bytes);
+#endif
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printfootprint(int n, stats_t *stats);
+static void printlines(int n, stats_t *stats);
 static void usage(void);
 static void unix_error(const char *msg);
 static void malloc_error(int tracenum, int opnum, const char *msg);
@@ -147,10 +289,25 @@ int main(int argc, char **argv)
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    scale_t *mm_scale = NULL;  /* mm thread scaling for each trace (-T) */
+    scale_t *libc_scale = NULL;/* libc thread scaling for each trace (-T) */
+    hist_t (*mm_lat)[NUM_REQUEST_TYPES] = NULL; /* op latencies per trace (-L) */
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int nthreads = 0;    /* If set, also replay with this many threads (-T) */
+    int latency = 0;     /* If set, time every request of mm.c (-L) */
+    char *csvfile = NULL;/* If set, write the latency histograms here (-C) */
+    int stream = 0;      /* If set, stream traces through a reader thread (-s) */
+    FILE *timeline = NULL;/* If set, write the fragmentation timeline here (-F) */
+    int every = TIMELINE_EVERY; /* requests between timeline snapshots (-I) */
+    int policies = 0;    /* If set, compare every placement policy (-p all) */
+    char *profile = NULL;/* If set, profile the traces and write size classes here (-P) */
+    profile_t prof;      /* the profile of all the traces (-P) */
+    FILE *fp;
+    int classbench = 0;  /* If set, time the size class lookups of mm.c (-S) */
+    double lookup[3];    /* cycles per lookup with the table, arithmetic and a search (-S) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -159,7 +316,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:T:C:F:I:p:H:c:P:hvVgalLsdSKMX")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -180,6 +337,77 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+	case 'T': /* Replay each trace on several threads at once */
+	    nthreads = atoi(optarg);
+	    if (nthreads < 1 || nthreads > MAXTHREADS) {
+		fprintf(stderr, "-T takes 1 to %d threads\n", MAXTHREADS);
+		exit(1);
+	    }
+	    break;
+	case 's': /* Stream the traces instead of loading them */
+	    stream = 1;
+	    break;
+	case 'L': /* Report the latency of each mm request */
+	    latency = 1;
+	    break;
+	case 'C': /* Export the latency histograms as CSV */
+	    latency = 1;
+	    csvfile = strdup(optarg);
+	    break;
+	case 'F': /* Export a fragmentation timeline as CSV */
+#if MM_EVENTS
+	    if ((timeline = fopen(optarg, "w")) == NULL)
+		unix_error("Could not open timeline CSV file");
+#else
+	    fprintf(stderr, "-F needs mm.c built with MM_EVENTS set in config.h\n");
+	    exit(1);
+#endif
+	    break;
+	case 'I': /* Requests between timeline snapshots */
+	    every = atoi(optarg);
+	    if (every < 1) {
+		fprintf(stderr, "-I takes a positive number of requests\n");
+		exit(1);
+	    }
+	    break;
+	case 'p': /* Placement policy of mm.c, or all of them in turn */
+	    if (!strcmp(optarg, "all"))
+		policies = 1;
+	    else
+		mm_set_fit(fit_policy = lookup_fit(optarg));
+	    break;
+	case 'H': /* Largest heap memlib allows, in MB */
+	    if (atol(optarg) < 1) {
+		fprintf(stderr, "-H takes a positive number of megabytes\n");
+		exit(1);
+	    }
+	    mem_set_heap_limit((size_t)atol(optarg) << 20);
+	    break;
+	case 'd': /* Defer coalescing in mm.c */
+	    mm_set_defer(1);
+	    break;
+	case 'K': /* Keep small payloads within a cache line */
+	    mm_set_lines(1);
+	    break;
+	case 'S': /* Time size class lookups instead of running the traces */
+	    classbench = 1;
+	    break;
+	case 'P': /* Profile the traces instead of running them */
+	    profile = strdup(optarg);
+	    break;
+	case 'M': /* Allocate with mm_memalign while checking validity */
+	    memalign_test = 1;
+	    break;
+	case 'X': /* Allocate with mm_malloc_flags while checking validity */
+	    line_test = 1;
+	    break;
+	case 'c': /* Check the heap while checking validity */
+	    check_every = atoi(optarg);
+	    if (check_every < 1) {
+		fprintf(stderr, "-c takes a positive number of requests\n");
+		exit(1);
+	    }
+	    break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
@@ -237,6 +465,44 @@ int main(int argc, char **argv)
 	printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    /*
+     * With -P, profile the requests of the traces, suggest size classes
+     * for them and stop; nothing is run or timed
+     */
+    if (profile != NULL) {
+	profile_init(&prof);
+	for (i = 0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    profile_trace(&prof, tracefiles[i], trace->ops, trace->num_ops, trace->num_ids);
+	    free_trace(trace);
+	}
+	profile_print(&prof, stdout);
+	if ((fp = fopen(profile, "w")) == NULL)
+	    unix_error("Could not open size class header");
+	profile_header(&prof, fp);
+	fclose(fp);
+	printf("Wrote the suggested classes to %s\n", profile);
+	exit(0);
+    }
+
+    /*
+     * With -S, compare the size class table of mm.c with the arithmetic
+     * it replaced on the request sizes of each trace, and stop
+     */
+    if (classbench) {
+	printf("\nSize class lookups, cycles per request (%d classes up to %d bytes):\n",
+	       SLAB_CLASSES, SLAB_MAX);
+	printf("%5s %10s %8s %8s %8s\n", "trace", "requests", "table", "arith", "search");
+	for (i = 0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    eval_class_lookup(trace, lookup);
+	    printf("%5d %10d %8.2f %8.2f %8.2f   %s\n", i, trace->num_ops,
+		   lookup[0], lookup[1], lookup[2], tracefiles[i]);
+	    free_trace(trace);
+	}
+	exit(0);
+    }
+
     /* Initialize the timing package */
     init_fsecs();
 
@@ -264,6 +530,7 @@ int main(int argc, char **argv)
 		if (verbose > 1)
 		    printf("and performance.\n");
 		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+		libc_stats[i].has_hw = fsecs_counters(&libc_stats[i].hw);
 	    }
 	    free_trace(trace);
 	}
@@ -272,6 +539,7 @@ int main(int argc, char **argv)
 	if (verbose) {
 	    printf("\nResults for libc malloc:\n");
 	    printresults(num_tracefiles, libc_stats);
+	    printcounters(num_tracefiles, libc_stats);
 	}
     }
 
@@ -285,12 +553,21 @@ int main(int argc, char **argv)
     mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
     if (mm_stats == NULL)
 	unix_error("mm_stats calloc in main failed");
+    if (latency) {
+	mm_lat = calloc(num_tracefiles, sizeof(*mm_lat));
+	if (mm_lat == NULL)
+	    unix_error("mm_lat calloc in main failed");
+    }
     
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
+	if (stream) {
+	    eval_mm_stream(tracedir, tracefiles[i], &mm_stats[i]);
+	    continue;
+	}
 	trace = read_trace(tracedir, tracefiles[i]);
 	mm_stats[i].ops = trace->num_ops;
 	if (verbose > 1)
@@ -299,20 +576,73 @@ int main(int argc, char **argv)
 	if (mm_stats[i].valid) {
 	    if (verbose > 1)
 		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+	    mm_stats[i].util = eval_mm_util(trace, i, &ranges, &mm_stats[i].mem);
+	    mm_fitstats(&mm_stats[i].fit);
 	    speed_params.trace = trace;
 	    speed_params.ranges = ranges;
 	    if (verbose > 1)
 		printf("and performance.\n");
 	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    mm_stats[i].has_hw = fsecs_counters(&mm_stats[i].hw);
+	    if (latency)
+		eval_mm_latency(trace, mm_lat[i]);
+#if MM_EVENTS
+	    if (timeline != NULL)
+		eval_mm_timeline(trace, i, timeline, every);
+#endif
 	}
 	free_trace(trace);
     }
+    if (timeline != NULL)
+	fclose(timeline);
 
     /* Display the mm results in a compact table */
     if (verbose) {
 	printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
+	printcounters(num_tracefiles, mm_stats);
+	printf("\n");
+	if (!stream) {
+	    printfit(num_tracefiles, mm_stats);
+	    printf("\n");
+	    printfootprint(num_tracefiles, mm_stats);
+	    printf("\n");
+	    printlines(num_tracefiles, mm_stats);
+	    printf("\n");
+	}
+    }
+
+    /* Optionally run every trace under every placement policy */
+    if (policies && errors == 0) {
+	eval_policies(num_tracefiles, tracefiles);
+	printf("\n");
+    }
+
+    /* Display and export the latency histograms */
+    if (latency && errors == 0) {
+	printlatency(num_tracefiles, mm_lat);
+	printf("\n");
+	if (csvfile != NULL)
+	    write_latency_csv(csvfile, num_tracefiles, tracefiles, mm_lat);
+    }
+
+    /*
+     * Optionally measure how mm.c and libc scale with threads
+     */
+    if (nthreads > 0 && errors == 0) {
+	if (verbose > 1)
+	    printf("\nMeasuring scaling with %d threads\n", nthreads);
+	mm_scale = (scale_t *)calloc(num_tracefiles, sizeof(scale_t));
+	libc_scale = (scale_t *)calloc(num_tracefiles, sizeof(scale_t));
+	if (mm_scale == NULL || libc_scale == NULL)
+	    unix_error("scale calloc in main failed");
+	for (i=0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    eval_scaling(trace, nthreads, 0, &mm_scale[i]);
+	    eval_scaling(trace, nthreads, 1, &libc_scale[i]);
+	    free_trace(trace);
+	}
+	printscaling(num_tracefiles, nthreads, mm_scale, libc_scale);
 	printf("\n");
     }
 
@@ -369,22 +699,27 @@ int main(int argc, char **argv)
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks in O(log n).
  ****************************************************************/
 
+#define RANGE_CHUNK 1024 /* range_t nodes the pool gets from malloc at once */
+
+static range_t *range_pool = NULL; /* free nodes, linked through right */
+static unsigned range_seed = 1;    /* state of the priority generator */
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range tree. 
  */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *pred = NULL, *succ = NULL;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -397,36 +732,53 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or of the
+       region mem_map hands out mappings from */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	((lo < (char *)mem_map_lo()) || (hi > (char *)mem_map_hi()))) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* 
+     * The payload must not overlap any other payloads. The payloads
+     * already in the tree are disjoint, so only the one starting at
+     * or below lo and the one starting just above it can overlap.
+     */
+    for (p = *ranges;  p != NULL; ) {
+	if (p->lo <= lo) {
+	    pred = p;
+	    p = p->right;
+	}
+	else {
+	    succ = p;
+	    p = p->left;
+	}
+    }
+    if (pred != NULL && pred->hi >= lo)
+	p = pred;
+    else if (succ != NULL && succ->lo <= hi)
+	p = succ;
+    else
+	p = NULL;
+    if (p != NULL) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = new_range();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    *ranges = insert_range(*ranges, p);
     return 1;
 }
 
@@ -435,33 +787,126 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            // int size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
-    }
+    *ranges = delete_range(*ranges, lo);
 }
 
 /*
  * clear_ranges - free all of the range records for a trace 
  */
 static void clear_ranges(range_t **ranges)
+{
+    range_t *p = *ranges;
+
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    free_range(p);
+    *ranges = NULL;
+}
+
+/*
+ * insert_range - Insert node into the treap rooted at root, rotating it
+ *     up while its priority beats its parent's; returns the new root
+ */
+static range_t *insert_range(range_t *root, range_t *node)
+{
+    range_t *child;
+
+    if (root == NULL)
+	return node;
+    if (node->lo < root->lo) {
+	root->left = child = insert_range(root->left, node);
+	if (child->prio > root->prio) {
+	    root->left = child->right;
+	    child->right = root;
+	    return child;
+	}
+    }
+    else {
+	root->right = child = insert_range(root->right, node);
+	if (child->prio > root->prio) {
+	    root->right = child->left;
+	    child->left = root;
+	    return child;
+	}
+    }
+    return root;
+}
+
+/*
+ * delete_range - Remove the node starting at lo from the treap rooted at
+ *     root, if there is one; returns the new root
+ */
+static range_t *delete_range(range_t *root, char *lo)
+{
+    range_t *child;
+
+    if (root == NULL)
+	return NULL;
+    if (lo < root->lo) {
+	root->left = delete_range(root->left, lo);
+	return root;
+    }
+    if (lo > root->lo) {
+	root->right = delete_range(root->right, lo);
+	return root;
+    }
+
+    /* Rotate the node down toward its higher priority child until it
+       has at most one child, then splice it out */
+    if (root->left == NULL || root->right == NULL) {
+	child = root->left ? root->left : root->right;
+	free_range(root);
+	return child;
+    }
+    if (root->left->prio > root->right->prio) {
+	child = root->left;
+	root->left = child->right;
+	child->right = delete_range(root, lo);
+    }
+    else {
+	child = root->right;
+	root->right = child->left;
+	child->left = delete_range(root, lo);
+    }
+    return child;
+}
+
+/*
+ * new_range - Take a node from the pool, refilling it from malloc
+ *     RANGE_CHUNK nodes at a time. Nodes are never given back to malloc.
+ */
+static range_t *new_range(void)
 {
     range_t *p;
-    range_t *pnext;
+    int i;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+    if (range_pool == NULL) {
+	if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+	    unix_error("malloc error in new_range");
+	for (i = 0; i < RANGE_CHUNK; i++)
+	    free_range(&p[i]);
     }
-    *ranges = NULL;
+    p = range_pool;
+    range_pool = p->right;
+
+    /* xorshift32 */
+    range_seed ^= range_seed << 13;
+    range_seed ^= range_seed >> 17;
+    range_seed ^= range_seed << 5;
+    p->prio = range_seed;
+    p->left = p->right = NULL;
+    return p;
+}
+
+/*
+ * free_range - Return node p to the pool
+ */
+static void free_range(range_t *p)
+{
+    p->right = range_pool;
+    range_pool = p;
 }
 
 
@@ -488,10 +933,24 @@ static trace_t *read_trace(char *tracedir, char *filename)
     /* Allocate the trace record */
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
 	unix_error("malloc 1 failed in read_trance");
+    trace->map = NULL;
+    trace->map_len = 0;
 	
     /* Read the trace file header */
     strcpy(path, tracedir);
     strcat(path, filename);
+
+    /* A binary trace needs no parsing, its ops are used where they lie */
+    if (map_bintrace(trace, path)) {
+	if ((trace->blocks = 
+	     (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	    unix_error("malloc 3 failed in read_trace");
+	if ((trace->block_sizes = 
+	     (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	    unix_error("malloc 4 failed in read_trace");
+	return trace;
+    }
+
     if ((tracefile = fopen(path, "r")) == NULL) {
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
@@ -569,13 +1028,87 @@ static trace_t *read_trace(char *tracedir, char *filename)
     return trace;
 }
 
+/*
+ * map_bintrace - If path is a binary trace (see trace.h), map it and
+ *     point trace->ops at the records in the mapping. Returns 0, with
+ *     nothing mapped, if the file is not a binary trace.
+ */
+static int map_bintrace(trace_t *trace, char *path)
+{
+    bintrace_hdr_t hdr;
+    struct stat st;
+    traceop_t *op;
+    void *map;
+    int fd, i;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+	snprintf(msg, sizeof(msg), "Could not open %s in read_trace", path);
+	unix_error(msg);
+    }
+    if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	memcmp(hdr.magic, BINTRACE_MAGIC, sizeof(BINTRACE_MAGIC)) != 0) {
+	close(fd);
+	return 0;
+    }
+    if (hdr.version != BINTRACE_VERSION) {
+	snprintf(msg, sizeof(msg), "%s is binary trace version %u, expected %d",
+		 path, hdr.version, BINTRACE_VERSION);
+	app_error(msg);
+    }
+    if (hdr.num_ids < 0 || hdr.num_ops < 0) {
+	snprintf(msg, sizeof(msg), "%s has a negative id or op count", path);
+	app_error(msg);
+    }
+    if (fstat(fd, &st) < 0)
+	unix_error("fstat failed in map_bintrace");
+    if ((size_t)st.st_size != sizeof(hdr) + hdr.num_ops * sizeof(traceop_t)) {
+	snprintf(msg, sizeof(msg), "%s is truncated or has trailing bytes", path);
+	app_error(msg);
+    }
+    if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+	unix_error("mmap failed in map_bintrace");
+    close(fd);
+
+    trace->sugg_heapsize = hdr.sugg_heapsize;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->weight = hdr.weight;
+    trace->ops = (traceop_t *)((char *)map + sizeof(hdr));
+    trace->map = map;
+    trace->map_len = st.st_size;
+
+    /* The ops are used as they are, so they have to be sane */
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	if (op->type != ALLOC && op->type != FREE && op->type != REALLOC) {
+	    snprintf(msg, sizeof(msg), "%s: op %d has bogus type %d",
+		     path, i, (int)op->type);
+	    app_error(msg);
+	}
+	if (op->index < 0 || op->index >= trace->num_ids) {
+	    snprintf(msg, sizeof(msg), "%s: op %d has id %d, not in [0, %d)",
+		     path, i, op->index, trace->num_ids);
+	    app_error(msg);
+	}
+	if (op->type != FREE && op->size < 0) {
+	    snprintf(msg, sizeof(msg), "%s: op %d has negative size %d",
+		     path, i, op->size);
+	    app_error(msg);
+	}
+    }
+    return 1;
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
  *              to, all of which were allocated in read_trace().
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map != NULL)   /* free the three arrays... */
+	munmap(trace->map, trace->map_len);
+    else
+	free(trace->ops);
     free(trace->blocks);      
     free(trace->block_sizes);
     free(trace);              /* and the trace record itself... */
@@ -586,6 +1119,42 @@ void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * next_align - Alignment -M asks mm_memalign for in request opnum:
+ *     every power of two from ALIGNMENT to MEMALIGN_MAX in turn
+ */
+static size_t next_align(int opnum)
+{
+    int steps = 0;
+
+    while (((size_t)ALIGNMENT << steps) < MEMALIGN_MAX)
+	steps++;
+    return (size_t)ALIGNMENT << (opnum % (steps + 1));
+}
+
+/*
+ * check_lines - Check that the payload of size bytes at p, from request
+ *     opnum, is placed on the cache lines the MM_LINE_xxx flags ask for
+ */
+static int check_lines(char *p, int size, int flags, int tracenum, int opnum)
+{
+    unsigned long lines = ((uintptr_t)p + size - 1) / MM_CACHE_LINE -
+	(uintptr_t)p / MM_CACHE_LINE + 1;
+
+    if ((flags & MM_LINE_EXCLUSIVE) && (uintptr_t)p % MM_CACHE_LINE != 0) {
+	sprintf(msg, "MM_LINE_EXCLUSIVE payload (%p) does not start a cache line", p);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+    if (size > 0 && lines > (unsigned long)(size + MM_CACHE_LINE - 1) / MM_CACHE_LINE) {
+	sprintf(msg, "MM_LINE_NOCROSS payload (%p) of %d bytes spans %lu cache lines",
+		p, size, lines);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+    return 1;
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
@@ -595,6 +1164,9 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     int index;
     int size;
     int oldsize;
+    int nerr;
+    int flags, extent;
+    size_t align;
     char *newp;
     char *oldp;
     char *p;
@@ -618,18 +1190,50 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         case ALLOC: /* mm_malloc */
 
-	    /* Call the student's malloc */
-	  if ((p = (char*) mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+	    /* 
+	     * Call the student's malloc, or with -M mm_memalign with an
+	     * alignment that cycles from ALIGNMENT to MEMALIGN_MAX bytes,
+	     * or with -X mm_malloc_flags with each of the MM_LINE_xxx flags.
+	     * With both, they take turns; a request gets one or the other.
+	     */
+	    j = memalign_test && line_test ? i / 2 : i;
+	    align = 0;
+	    flags = 0;
+	    if (line_test && (!memalign_test || i % 2))
+		flags = j % 2 ? MM_LINE_EXCLUSIVE : MM_LINE_NOCROSS;
+	    else if (memalign_test)
+		align = next_align(j);
+	    if (align)
+		p = (char *) mm_memalign(align, size);
+	    else if (flags)
+		p = (char *) mm_malloc_flags(size, flags);
+	    else
+		p = (char *) mm_malloc(size);
+	    if (p == NULL) {
+		malloc_error(tracenum, i, align ? "mm_memalign failed." :
+			     flags ? "mm_malloc_flags failed." : "mm_malloc failed.");
 		return 0;
 	    }
+	    if (align && (uintptr_t)p % align != 0) {
+		sprintf(msg, "mm_memalign payload (%p) not aligned to %lu bytes",
+			p, (unsigned long)align);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
+	    if (flags && !check_lines(p, size, flags, tracenum, i))
+		return 0;
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
 	     * to the range list if OK. The block must be  be aligned properly,
-	     * and must not overlap any currently allocated block. 
+	     * and must not overlap any currently allocated block. An
+	     * MM_LINE_EXCLUSIVE payload claims the rest of its last cache
+	     * line as well, so no other payload may share it.
 	     */ 
-	    if (add_range(ranges, p, size, tracenum, i) == 0)
+	    extent = size;
+	    if (flags & MM_LINE_EXCLUSIVE)
+		extent = (size + MM_CACHE_LINE - 1) / MM_CACHE_LINE * MM_CACHE_LINE;
+	    if (add_range(ranges, p, extent, tracenum, i) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -668,7 +1272,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char) newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -693,24 +1297,66 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 
+	/* 
+	 * With -c, check the whole heap every check_every requests and
+	 * the blocks the request changed after the others
+	 */
+	if (check_every > 0) {
+	    nerr = (i + 1) % check_every ? mm_checkrecent(0) : mm_checkheap(0);
+	    if (nerr > 0) {
+		sprintf(msg, "mm_checkheap found %d errors.", nerr);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
+	}
+    }
+
+    /* One last full check of the heap the trace left behind */
+    if (check_every > 0 && (nerr = mm_checkheap(0)) > 0) {
+	sprintf(msg, "mm_checkheap found %d errors.", nerr);
+	malloc_error(tracenum, trace->num_ops, msg);
+	return 0;
     }
 
     /* As far as we know, this is a valid malloc package */
     return 1;
 }
 
+/*
+ * count_lines - Counts a payload of size bytes at p in *mem, and whether
+ *     it spans more MM_CACHE_LINE lines than a payload of its size must
+ */
+static void count_lines(footprint_t *mem, char *p, int size)
+{
+    unsigned long first, last;
+
+    if (size <= 0)
+	return;
+    mem->payloads++;
+    first = (unsigned long)p / MM_CACHE_LINE;
+    last = ((unsigned long)p + size - 1) / MM_CACHE_LINE;
+    if (last - first + 1 > (unsigned long)(size + MM_CACHE_LINE - 1) / MM_CACHE_LINE) {
+	mem->split++;
+	if (size <= MM_CACHE_LINE)
+	    mem->small_split++;
+    }
+}
+
 /* 
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   largest size of the heap in bytes while running the student's
+ *   malloc package on the trace. mem_sbrk() lets the brk move back
+ *   down, so this is the peak rather than the final size, and it
+ *   includes any blocks mapped outside the heap with mem_map(), i.e.
+ *   it is mem_peak_footprint().
+ *   Along the way, the resident part of the heap is sampled every
+ *   RESIDENT_EVERY requests into *mem.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   footprint_t *mem)
 {   
     int i;
     int index;
@@ -719,11 +1365,14 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
     int total_size = 0;
     char *p;
     char *newp, *oldp;
+    double rss;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
     if (mm_init() < 0)
 	app_error("mm_init failed in eval_mm_util");
+    mem->rss_peak = 0;
+    mem->payloads = mem->split = mem->small_split = 0;
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
@@ -734,6 +1383,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
 	    if ((p = (char *) mm_malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
+	    count_lines(mem, p, size);
 	    
 	    /* Remember region and size */
 	    trace->blocks[index] = p;
@@ -756,6 +1406,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    oldp = trace->blocks[index];
 	    if ((newp = (char *) mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
+	    count_lines(mem, newp, newsize);
 
 	    /* Remember region and size */
 	    trace->blocks[index] = newp;
@@ -787,9 +1438,17 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+	if (i % RESIDENT_EVERY == 0 && (rss = mem_resident()) > mem->rss_peak)
+	    mem->rss_peak = rss;
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    mem->heap_peak = mem_peak_heapsize();
+    mem->heap_end = mem_heapsize();
+    mem->map_peak = mem_peak_footprint();
+    mem->rss_end = mem_resident();
+    if (mem->rss_end > mem->rss_peak)
+	mem->rss_peak = mem->rss_end;
+    return ((double)max_total_size / (double)mem_peak_footprint());
 }
 
 
@@ -840,6 +1499,457 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * eval_mm_latency - Replay the trace once more, timing every request
+ *    with the cycle counter. hists[t] collects the cycles taken by each
+ *    request of type t, less the counter's own overhead.
+ */
+static void eval_mm_latency(trace_t *trace, hist_t *hists)
+{
+    int i, index, size;
+    char *p;
+    double cycles, overhead;
+
+    for (i = 0; i < NUM_REQUEST_TYPES; i++)
+	hist_reset(&hists[i]);
+    overhead = ovhd();
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+        case ALLOC:
+	    start_counter();
+	    p = mm_malloc(size);
+	    cycles = get_counter();
+	    if (p == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+	    trace->blocks[index] = p;
+	    break;
+
+	case REALLOC:
+	    start_counter();
+	    p = mm_realloc(trace->blocks[index], size);
+	    cycles = get_counter();
+	    if (p == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+	    trace->blocks[index] = p;
+	    break;
+
+        case FREE:
+	    start_counter();
+	    mm_free(trace->blocks[index]);
+	    cycles = get_counter();
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+	    return;
+	}
+	cycles -= overhead;
+	hist_add(&hists[trace->ops[i].type], cycles > 0 ? (unsigned long long)cycles : 0);
+    }
+}
+
+/*
+ * eval_class_lookup - Time how long mm.c takes to find the block size
+ *    and slab class of each malloc and realloc request in the trace.
+ *    cycles[0] is with its lookup table, cycles[1] with the division
+ *    it replaced (right only for one class per ALIGNMENT bytes), and
+ *    cycles[2] with a search of the class slots, which any other class
+ *    spec would need without a table.
+ */
+static void eval_class_lookup(trace_t *trace, double cycles[3])
+{
+    unsigned int *sizes, s, asize, slab;
+    unsigned long sum = 0;
+    int i, n = 0, m, rep, reps;
+
+    if ((sizes = malloc(trace->num_ops * sizeof(unsigned int))) == NULL)
+	unix_error("malloc failed in eval_class_lookup");
+    for (i = 0; i < trace->num_ops; i++)
+	if (trace->ops[i].type != FREE)
+	    sizes[n++] = trace->ops[i].size;
+    if (n == 0) {
+	cycles[0] = cycles[1] = cycles[2] = 0;
+	free(sizes);
+	return;
+    }
+    reps = (LOOKUP_MIN + n - 1) / n;
+
+    /* the search is the reference for the other two */
+    for (i = 0; i < n; i++) {
+	s = sizes[i];
+	for (slab = 0; slab < SLAB_CLASSES && slab_slot[slab] < s; slab++)
+	    ;
+	if (s <= TABLE_MAX && slab != (size_table[s].slab == NO_CLASS ?
+				       SLAB_CLASSES : size_table[s].slab))
+	    app_error("size_table disagrees with the class slots");
+    }
+
+    for (m = 0; m < 3; m++) {
+	start_counter();
+	for (rep = 0; rep < reps; rep++) {
+	    for (i = 0; i < n; i++) {
+		s = sizes[i];
+		switch (m) {
+		case 0: /* one load from the table */
+		    if (s <= TABLE_MAX) {
+			asize = size_table[s].asize;
+			slab = size_table[s].slab;
+		    }
+		    else {
+			asize = (s + TABLE_OVERHEAD + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+			slab = NO_CLASS;
+		    }
+		    break;
+		case 1: /* a division for each */
+		    if (s <= TABLE_MIN_BLOCK - TABLE_OVERHEAD)
+			asize = TABLE_MIN_BLOCK;
+		    else
+			asize = ALIGNMENT * ((s + TABLE_OVERHEAD + ALIGNMENT - 1) / ALIGNMENT);
+		    slab = s <= SLAB_MAX ? (s - 1) / ALIGNMENT : NO_CLASS;
+		    break;
+		default: /* the division, and a search for the class */
+		    if (s <= TABLE_MIN_BLOCK - TABLE_OVERHEAD)
+			asize = TABLE_MIN_BLOCK;
+		    else
+			asize = ALIGNMENT * ((s + TABLE_OVERHEAD + ALIGNMENT - 1) / ALIGNMENT);
+		    for (slab = 0; slab < SLAB_CLASSES && slab_slot[slab] < s; slab++)
+			;
+		    break;
+		}
+		sum += asize + slab;
+	    }
+	}
+	cycles[m] = get_counter() / ((double)reps * n);
+    }
+    free(sizes);
+
+    /* keep the compiler from dropping the loops */
+    if (sum == 0)
+	printf("\n");
+}
+
+#if MM_EVENTS
+/*
+ * eval_mm_timeline - Replay the trace once more and write a snapshot of
+ *    the heap to fp after every "every" requests and after the last one.
+ *    Each row also carries the allocator events counted since the row
+ *    before, so -I 1 gives the events of every single request.
+ */
+static void eval_mm_timeline(trace_t *trace, int tracenum, FILE *fp, int every)
+{
+    int i, index, size;
+    long live_bytes = 0;
+    char *p;
+    mm_events_t ev;
+
+    if (tracenum == 0)
+	fprintf(fp, "trace,op,heap_bytes,live_bytes,free_bytes,free_blocks,"
+		"largest_free,ext_frag,split,coalesce1,coalesce2,coalesce3,"
+		"coalesce4,extend,extend_bytes,trim,trim_bytes,searches,search_steps,"
+		"search_max,resident_bytes\n");
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_timeline");
+    mm_events(&ev);
+    write_snapshot(fp, tracenum, 0, 0);
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+        case ALLOC:
+	    if ((p = mm_malloc(size)) == NULL)
+		app_error("mm_malloc error in eval_mm_timeline");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    live_bytes += size;
+	    break;
+
+	case REALLOC:
+	    if ((p = mm_realloc(trace->blocks[index], size)) == NULL)
+		app_error("mm_realloc error in eval_mm_timeline");
+	    trace->blocks[index] = p;
+	    live_bytes += size - trace->block_sizes[index];
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case FREE:
+	    mm_free(trace->blocks[index]);
+	    live_bytes -= trace->block_sizes[index];
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_timeline");
+	}
+	if ((i + 1) % every == 0 || i + 1 == trace->num_ops)
+	    write_snapshot(fp, tracenum, i + 1, live_bytes);
+    }
+}
+
+/*
+ * write_snapshot - Write one timeline row. External fragmentation is
+ *    the share of free bytes outside the largest free block: 0 when all
+ *    free space is one block, near 1 when it is scattered in crumbs.
+ */
+static void write_snapshot(FILE *fp, int tracenum, int opnum, long live_bytes)
+{
+    mm_heapstat_t hs;
+    mm_events_t ev;
+
+    mm_heapstat(&hs);
+    mm_events(&ev);
+    fprintf(fp, "%d,%d,%lu,%ld,%lu,%lu,%lu,%.4f,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+	    tracenum, opnum, hs.heap_bytes, live_bytes, hs.free_bytes,
+	    hs.free_blocks, hs.largest_free,
+	    hs.free_bytes ? 1.0 - (double)hs.largest_free / hs.free_bytes : 0.0,
+	    ev.count[MM_EV_SPLIT], ev.count[MM_EV_COALESCE1],
+	    ev.count[MM_EV_COALESCE2], ev.count[MM_EV_COALESCE3],
+	    ev.count[MM_EV_COALESCE4], ev.count[MM_EV_EXTEND],
+	    ev.extend_bytes, ev.count[MM_EV_TRIM], ev.trim_bytes,
+	    ev.count[MM_EV_SEARCH], ev.search_steps, ev.search_max,
+	    (unsigned long)mem_resident());
+}
+#endif
+
+/*
+ * eval_mm_stream - Replay a trace while a reader thread is still
+ *    reading it, in memory that does not grow with the trace length.
+ *    Requests arrive in batches through a ring of STREAM_RING slots,
+ *    and the id -> block table is grown only as far as the ids seen.
+ *    Measures utilization and throughput in one pass; the time spent
+ *    waiting for the reader is not counted. That pass cannot be rerun
+ *    by fsecs(), so it is timed with wall_secs() around each batch
+ *    whatever USE_xxx timer config.h selects, and its Kops are not
+ *    exactly comparable with those of the other modes. Payloads are
+ *    not checked, so validate new allocators without -s first; only
+ *    ids that are not allocated when freed or realloc'd are caught.
+ */
+static void eval_mm_stream(char *tracedir, char *filename, stats_t *stats)
+{
+    stream_t *st;
+    pthread_t reader;
+    batch_t *b;
+    bintrace_hdr_t hdr;
+    char path[MAXLINE];
+    char **blocks = NULL;      /* id -> block, grown on demand */
+    int *sizes = NULL;         /* id -> payload size */
+    int num_ids = 0;           /* entries in blocks and sizes */
+    int i, n, index, size;
+    long total_size = 0, max_total_size = 0;
+    double ops = 0, secs = 0, t0;
+    char *p;
+
+    if (verbose > 1)
+	printf("Streaming tracefile: %s\n", filename);
+    if ((st = (stream_t *)calloc(1, sizeof(stream_t))) == NULL)
+	unix_error("calloc failed in eval_mm_stream");
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    st->path = path;
+    if ((st->fp = fopen(path, "r")) == NULL) {
+	snprintf(msg, sizeof(msg), "Could not open %.*s in eval_mm_stream",
+		 MAXLINE / 2, path);
+	unix_error(msg);
+    }
+
+    /* Skip the header; the counts in it are not needed */
+    st->binary = fread(&hdr, sizeof(hdr), 1, st->fp) == 1 &&
+	memcmp(hdr.magic, BINTRACE_MAGIC, sizeof(BINTRACE_MAGIC)) == 0;
+    if (!st->binary) {
+	rewind(st->fp);
+	if (fscanf(st->fp, "%d %d %d %d", &hdr.sugg_heapsize, &hdr.num_ids,
+		   &hdr.num_ops, &hdr.weight) != 4)
+	    app_error("bad trace header in eval_mm_stream");
+    }
+
+    pthread_mutex_init(&st->lock, NULL);
+    pthread_cond_init(&st->not_full, NULL);
+    pthread_cond_init(&st->not_empty, NULL);
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_stream");
+    if (pthread_create(&reader, NULL, stream_reader, st) != 0)
+	unix_error("pthread_create in eval_mm_stream failed");
+
+    for (;;) {
+	/* Wait for the next batch */
+	pthread_mutex_lock(&st->lock);
+	while (st->tail == st->head)
+	    pthread_cond_wait(&st->not_empty, &st->lock);
+	pthread_mutex_unlock(&st->lock);
+	b = &st->ring[st->tail % STREAM_RING];
+	if (b->n == 0)
+	    break;
+
+	t0 = wall_secs();
+	for (i = 0; i < b->n; i++) {
+	    index = b->ops[i].index;
+	    size = b->ops[i].size;
+
+	    /* Grow the id table geometrically the first time an id shows up */
+	    if (index < 0)
+		app_error("negative id in eval_mm_stream");
+	    if (index >= num_ids) {
+		n = num_ids;
+		while (num_ids <= index)
+		    num_ids = num_ids ? 2*num_ids : 1024;
+		if ((blocks = (char **)realloc(blocks, num_ids * sizeof(char *))) == NULL ||
+		    (sizes = (int *)realloc(sizes, num_ids * sizeof(int))) == NULL)
+		    unix_error("realloc failed in eval_mm_stream");
+		memset(blocks + n, 0, (num_ids - n) * sizeof(char *));
+		memset(sizes + n, 0, (num_ids - n) * sizeof(int));
+	    }
+	    if (b->ops[i].type != ALLOC && blocks[index] == NULL) {
+		snprintf(msg, sizeof(msg), "%s: id %d is not allocated in eval_mm_stream",
+			 filename, index);
+		app_error(msg);
+	    }
+
+	    switch (b->ops[i].type) {
+	    case ALLOC:
+		if ((p = mm_malloc(size)) == NULL)
+		    app_error("mm_malloc error in eval_mm_stream");
+		blocks[index] = p;
+		sizes[index] = size;
+		total_size += size;
+		break;
+
+	    case REALLOC:
+		if ((p = mm_realloc(blocks[index], size)) == NULL)
+		    app_error("mm_realloc error in eval_mm_stream");
+		blocks[index] = p;
+		total_size += size - sizes[index];
+		sizes[index] = size;
+		break;
+
+	    case FREE:
+		mm_free(blocks[index]);
+		blocks[index] = NULL;
+		total_size -= sizes[index];
+		sizes[index] = 0;
+		break;
+
+	    default:
+		app_error("invalid operation type in eval_mm_stream");
+	    }
+	    if (total_size > max_total_size)
+		max_total_size = total_size;
+	}
+	secs += wall_secs() - t0;
+	ops += b->n;
+
+	/* Hand the slot back to the reader */
+	pthread_mutex_lock(&st->lock);
+	st->tail++;
+	pthread_cond_signal(&st->not_full);
+	pthread_mutex_unlock(&st->lock);
+    }
+
+    pthread_join(reader, NULL);
+    fclose(st->fp);
+    pthread_mutex_destroy(&st->lock);
+    pthread_cond_destroy(&st->not_full);
+    pthread_cond_destroy(&st->not_empty);
+    free(st);
+    free(blocks);
+    free(sizes);
+
+    stats->valid = 1;
+    stats->ops = ops;
+    stats->secs = secs;
+    stats->util = ((double)max_total_size / (double)mem_peak_footprint());
+}
+
+/*
+ * stream_reader - Reader thread of eval_mm_stream: fill free ring slots
+ *    with batches of requests, ending with an empty batch
+ */
+static void *stream_reader(void *ptr)
+{
+    stream_t *st = (stream_t *)ptr;
+    batch_t *b;
+
+    do {
+	pthread_mutex_lock(&st->lock);
+	while (st->head - st->tail == STREAM_RING)
+	    pthread_cond_wait(&st->not_full, &st->lock);
+	pthread_mutex_unlock(&st->lock);
+
+	/* The slot is ours until head moves past it */
+	b = &st->ring[st->head % STREAM_RING];
+	b->n = read_ops(st, b->ops, STREAM_BATCH);
+
+	pthread_mutex_lock(&st->lock);
+	st->head++;
+	pthread_cond_signal(&st->not_empty);
+	pthread_mutex_unlock(&st->lock);
+    } while (b->n > 0);
+    return NULL;
+}
+
+/*
+ * read_ops - Read up to max requests of a streamed trace into ops;
+ *    returns how many were read, 0 at the end of the trace
+ */
+static int read_ops(stream_t *st, traceop_t *ops, int max)
+{
+    char type[MAXLINE];
+    int i, n;
+
+    if (st->binary) {
+	/* Records go to the replay as they are, so check them like
+	   map_bintrace does */
+	n = fread(ops, sizeof(traceop_t), max, st->fp);
+	for (i = 0; i < n; i++) {
+	    if (ops[i].type != ALLOC && ops[i].type != FREE &&
+		ops[i].type != REALLOC) {
+		snprintf(msg, sizeof(msg), "%.*s: record has bogus type %d",
+			 MAXLINE / 2, st->path, (int)ops[i].type);
+		app_error(msg);
+	    }
+	    if (ops[i].type != FREE && ops[i].size < 0) {
+		snprintf(msg, sizeof(msg), "%.*s: record has negative size %d",
+			 MAXLINE / 2, st->path, ops[i].size);
+		app_error(msg);
+	    }
+	}
+	return n;
+    }
+
+    for (n = 0; n < max && fscanf(st->fp, "%s", type) != EOF; n++) {
+	ops[n].size = 0;
+	switch (type[0]) {
+	case 'a':
+	case 'r':
+	    if (fscanf(st->fp, "%d %d", &ops[n].index, &ops[n].size) != 2)
+		app_error("fscanf of allocation in read_ops");
+	    ops[n].type = (type[0] == 'a') ? ALLOC : REALLOC;
+	    break;
+	case 'f':
+	    if (fscanf(st->fp, "%d", &ops[n].index) != 1)
+		app_error("fscanf of free in read_ops");
+	    ops[n].type = FREE;
+	    break;
+	default:
+	    printf("Bogus type character (%c) in tracefile %s\n", 
+		   type[0], st->path);
+	    exit(1);
+	}
+    }
+    return n;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -925,6 +2035,134 @@ static void eval_libc_speed(void *ptr)
     }
 }
 
+/*
+ * eval_scaling - Replay trace on 1 and then on nthreads threads at
+ *    once, each thread working on its own copy of the trace, and
+ *    record throughput and per-thread latency. Every thread count is
+ *    timed THREAD_REPS times and the fastest run is kept.
+ */
+static void eval_scaling(trace_t *trace, int nthreads, int use_libc, scale_t *sc)
+{
+    double thread_secs[MAXTHREADS];
+    double secs, best1 = DBL_MAX, bestn = DBL_MAX;
+    double sum = 0, max = 0;
+    int i, rep;
+
+    for (rep = 0; rep < THREAD_REPS; rep++) {
+	secs = eval_threads(trace, 1, use_libc, thread_secs);
+	if (secs < best1)
+	    best1 = secs;
+	secs = eval_threads(trace, nthreads, use_libc, thread_secs);
+	if (secs < bestn) {
+	    bestn = secs;
+	    sum = max = 0;
+	    for (i = 0; i < nthreads; i++) {
+		sum += thread_secs[i];
+		if (thread_secs[i] > max)
+		    max = thread_secs[i];
+	    }
+	}
+    }
+
+    sc->kops1 = (trace->num_ops/1e3)/best1;
+    sc->kopsn = (nthreads*(double)trace->num_ops/1e3)/bestn;
+    sc->usecs = (sum/nthreads)*1e6/trace->num_ops;
+    sc->maxusecs = max*1e6/trace->num_ops;
+}
+
+/*
+ * eval_threads - Run nthreads copies of trace concurrently against mm.c
+ *    or libc. Returns the wall time from the first thread starting
+ *    until the last one finishes; thread_secs gets each thread's own
+ *    time.
+ */
+static double eval_threads(trace_t *trace, int nthreads, int use_libc,
+			   double *thread_secs)
+{
+    pthread_t tid[MAXTHREADS];
+    thread_arg_t args[MAXTHREADS];
+    pthread_barrier_t start;
+    double t0 = DBL_MAX, t1 = 0;
+    int i;
+
+    /* All threads share one fresh mm heap */
+    if (!use_libc) {
+	mem_reset_brk();
+	if (mm_init() < 0)
+	    app_error("mm_init failed in eval_threads");
+    }
+
+    pthread_barrier_init(&start, NULL, nthreads + 1);
+    for (i = 0; i < nthreads; i++) {
+	args[i].trace = trace;
+	args[i].use_libc = use_libc;
+	args[i].start = &start;
+	if ((args[i].blocks = (char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
+	    unix_error("blocks calloc in eval_threads failed");
+	if (pthread_create(&tid[i], NULL, replay_thread, &args[i]) != 0)
+	    unix_error("pthread_create in eval_threads failed");
+    }
+    pthread_barrier_wait(&start);
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tid[i], NULL);
+
+    for (i = 0; i < nthreads; i++) {
+	thread_secs[i] = args[i].t1 - args[i].t0;
+	if (args[i].t0 < t0)
+	    t0 = args[i].t0;
+	if (args[i].t1 > t1)
+	    t1 = args[i].t1;
+	free(args[i].blocks);
+    }
+    pthread_barrier_destroy(&start);
+    return t1 - t0;
+}
+
+/*
+ * replay_thread - Body of one replay thread: wait for the others, then
+ *    run the whole trace against its own block array
+ */
+static void *replay_thread(void *ptr)
+{
+    thread_arg_t *arg = (thread_arg_t *)ptr;
+    trace_t *trace = arg->trace;
+    char **blocks = arg->blocks;
+    int i, index, size;
+    char *p;
+
+    pthread_barrier_wait(arg->start);
+    arg->t0 = wall_secs();
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+        case ALLOC:
+	    p = arg->use_libc ? malloc(size) : mm_malloc(size);
+	    if (p == NULL)
+		app_error("malloc failed in replay_thread");
+	    blocks[index] = p;
+	    break;
+
+	case REALLOC:
+	    p = arg->use_libc ? realloc(blocks[index], size)
+		: mm_realloc(blocks[index], size);
+	    if (p == NULL)
+		app_error("realloc failed in replay_thread");
+	    blocks[index] = p;
+	    break;
+
+        case FREE:
+	    if (arg->use_libc)
+		free(blocks[index]);
+	    else
+		mm_free(blocks[index]);
+	    break;
+	}
+    }
+    arg->t1 = wall_secs();
+    return NULL;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -987,6 +2225,298 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printscaling - prints the -T throughput and latency table. Efficiency
+ *    is the aggregate speedup over one thread divided by nthreads.
+ */
+static void printscaling(int n, int nthreads, scale_t *mm, scale_t *libc)
+{
+    int i, j;
+    scale_t *sc;
+    const char *name;
+    double kops1, kopsn;
+
+    printf("\nScaling with %d threads (independent copies of each trace):\n",
+	   nthreads);
+    printf("%5s%6s%9s%9s%9s%9s%7s\n",
+	   "trace", "pkg", "1T Kops", "nT Kops", "us/op", "max us", "eff");
+    for (j = 0; j < 2; j++) {
+	sc = j ? libc : mm;
+	name = j ? "libc" : "mm";
+	kops1 = kopsn = 0;
+	for (i = 0; i < n; i++) {
+	    printf("%2d%9s%9.0f%9.0f%9.3f%9.3f%6.0f%%\n",
+		   i, name,
+		   sc[i].kops1, sc[i].kopsn,
+		   sc[i].usecs, sc[i].maxusecs,
+		   100.0*sc[i].kopsn/(sc[i].kops1*nthreads));
+	    kops1 += sc[i].kops1;
+	    kopsn += sc[i].kopsn;
+	}
+	printf("%-5s%6s%9.0f%9.0f%18s%6.0f%%\n",
+	       "Mean", name, kops1/n, kopsn/n, "",
+	       100.0*kopsn/(kops1*nthreads));
+    }
+}
+
+/*
+ * lookup_fit - Index of the placement policy called name
+ */
+static int lookup_fit(const char *name)
+{
+    int p;
+
+    for (p = 0; p < MM_NUM_FITS; p++)
+	if (!strcmp(fit_names[p], name))
+	    return p;
+    fprintf(stderr, "Unknown placement policy %s\n", name);
+    exit(1);
+}
+
+/*
+ * eval_policies - Check, measure and time every trace under each
+ *    placement policy in turn, then put the policies side by side.
+ *    The policy chosen with -p (or the default) is restored after.
+ */
+static void eval_policies(int n, char **tracefiles)
+{
+    stats_t (*stats)[MM_NUM_FITS];
+    range_t *ranges = NULL;
+    speed_t speed_params;
+    trace_t *trace;
+    int i, p;
+
+    if ((stats = calloc(n, sizeof(*stats))) == NULL)
+	unix_error("stats calloc in eval_policies failed");
+
+    for (i = 0; i < n; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	for (p = 0; p < MM_NUM_FITS; p++) {
+	    if (verbose > 1)
+		printf("Measuring %s fit on %s\n", fit_names[p], tracefiles[i]);
+	    mm_set_fit(p);
+	    stats[i][p].ops = trace->num_ops;
+	    stats[i][p].valid = eval_mm_valid(trace, i, &ranges);
+	    if (!stats[i][p].valid)
+		continue;
+	    stats[i][p].util = eval_mm_util(trace, i, &ranges, &stats[i][p].mem);
+	    mm_fitstats(&stats[i][p].fit);
+	    speed_params.trace = trace;
+	    speed_params.ranges = ranges;
+	    stats[i][p].secs = fsecs(eval_mm_speed, &speed_params);
+	}
+	free_trace(trace);
+    }
+    mm_set_fit(fit_policy);
+
+    printpolicies(n, stats);
+    free(stats);
+}
+
+/*
+ * printfootprint - prints how big the heap got, with and without the
+ *    mappings of huge blocks, and how much of it was resident in RAM,
+ *    at its peak and after the last request
+ */
+static void printfootprint(int n, stats_t *stats)
+{
+    int i;
+
+    printf("Heap footprint (KB):\n");
+    printf("%5s%10s%10s%10s%10s%10s\n", "trace", "brk peak", "brk end", "+mapped", "rss peak", "rss end");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	printf("%2d%13.0f%10.0f%10.0f%10.0f%10.0f\n", i,
+	       stats[i].mem.heap_peak / 1024, stats[i].mem.heap_end / 1024,
+	       stats[i].mem.map_peak / 1024,
+	       stats[i].mem.rss_peak / 1024, stats[i].mem.rss_end / 1024);
+    }
+}
+
+/*
+ * printcounters - prints the IPC and the misses per request of each
+ *    trace during its timing runs, if hardware events were counted
+ *    (USE_PERF in config.h); an event that was not counted shows as "-"
+ */
+static void printcounters(int n, stats_t *stats)
+{
+    int i, e, any = 0;
+    fperf_counts_t *hw;
+    static const int misses[] = { FPERF_L1D_MISSES, FPERF_LLC_MISSES,
+				  FPERF_DTLB_MISSES, FPERF_BRANCH_MISSES };
+
+    for (i = 0; i < n; i++)
+	any |= stats[i].valid && stats[i].has_hw;
+    if (!any)
+	return;
+
+    printf("\nHardware events per request:\n");
+    printf("%5s%8s%7s%9s%9s%9s%9s\n", "trace", "Kops", "IPC",
+	   "L1D", "LLC", "dTLB", "branch");
+    for (i = 0; i < n; i++) {
+	hw = &stats[i].hw;
+	if (!stats[i].valid || !stats[i].has_hw)
+	    continue;
+	printf("%2d%11.0f", i, (stats[i].ops/1e3)/stats[i].secs);
+	if (hw->valid[FPERF_CYCLES] && hw->valid[FPERF_INSTRUCTIONS] &&
+	    hw->count[FPERF_CYCLES] > 0)
+	    printf("%7.2f", hw->count[FPERF_INSTRUCTIONS] / hw->count[FPERF_CYCLES]);
+	else
+	    printf("%7s", "-");
+	for (e = 0; e < (int)(sizeof(misses) / sizeof(misses[0])); e++) {
+	    if (hw->valid[misses[e]])
+		printf("%9.3f", hw->count[misses[e]] / stats[i].ops);
+	    else
+		printf("%9s", "-");
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * printlines - prints how many of the payloads of each trace spanned
+ *    more cache lines than their size needs, in all and among those no
+ *    bigger than a line
+ */
+static void printlines(int n, stats_t *stats)
+{
+    int i;
+    footprint_t *m;
+
+    printf("Cache line splits (%d-byte lines):\n", MM_CACHE_LINE);
+    printf("%5s%10s%10s%8s%10s\n", "trace", "payloads", "split", "%", "small");
+    for (i = 0; i < n; i++) {
+	m = &stats[i].mem;
+	if (!stats[i].valid)
+	    continue;
+	printf("%2d%13lu%10lu%8.1f%10lu\n", i, m->payloads, m->split,
+	       m->payloads ? 100.0 * m->split / m->payloads : 0.0, m->small_split);
+    }
+}
+
+/*
+ * printfit - prints how many free blocks find_fit examined per search
+ *    on each trace; with -V also the histogram of search lengths
+ */
+static void printfit(int n, stats_t *stats)
+{
+    int i, b;
+    mm_fitstats_t *fs;
+
+    printf("Free blocks examined per fit search (%s fit):\n", fit_names[fit_policy]);
+    printf("%5s%10s%10s%8s\n", "trace", "searches", "mean", "max");
+    for (i = 0; i < n; i++) {
+	fs = &stats[i].fit;
+	if (!stats[i].valid)
+	    continue;
+	printf("%2d%13lu%10.2f%8lu\n", i, fs->searches,
+	       fs->searches ? (double)fs->probes / fs->searches : 0.0, fs->max);
+	if (verbose > 1) {
+	    printf("%5s", "");
+	    for (b = 0; b < MM_PROBE_BUCKETS; b++)
+		if (fs->hist[b])
+		    printf(" %lu:%lu", b ? 1UL << (b - 1) : 0, fs->hist[b]);
+	    printf("\n");
+	}
+    }
+}
+
+/*
+ * printpolicies - prints utilization, throughput and search length of
+ *    every placement policy over all the traces
+ */
+static void printpolicies(int n, stats_t (*stats)[MM_NUM_FITS])
+{
+    int i, p;
+    double util, secs, ops;
+    unsigned long searches, probes, max;
+
+    printf("Placement policies:\n");
+    printf("%6s%6s%8s%10s%8s\n", "policy", "util", "Kops", "probes", "max");
+    for (p = 0; p < MM_NUM_FITS; p++) {
+	util = secs = ops = 0;
+	searches = probes = max = 0;
+	for (i = 0; i < n; i++) {
+	    if (!stats[i][p].valid)
+		break;
+	    util += stats[i][p].util;
+	    secs += stats[i][p].secs;
+	    ops += stats[i][p].ops;
+	    searches += stats[i][p].fit.searches;
+	    probes += stats[i][p].fit.probes;
+	    if (stats[i][p].fit.max > max)
+		max = stats[i][p].fit.max;
+	}
+	if (i < n) {
+	    printf("%6s%6s%8s%10s%8s\n", fit_names[p], "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%6s%5.0f%%%8.0f%10.2f%8lu\n", fit_names[p], util / n * 100.0,
+	       (ops / 1e3) / secs, searches ? (double)probes / searches : 0.0, max);
+    }
+}
+
+/*
+ * printlatency - prints the percentiles of every request type's latency
+ *    histogram, in CPU cycles, for each trace
+ */
+static void printlatency(int n, hist_t (*lat)[NUM_REQUEST_TYPES])
+{
+    int i, t;
+    hist_t *h;
+
+    printf("Latency of mm requests (cycles):\n");
+    printf("%5s%9s%8s%8s%8s%8s%9s%10s\n",
+	   "trace", "request", "count", "mean", "p50", "p99", "p99.9", "max");
+    for (i = 0; i < n; i++) {
+	for (t = 0; t < NUM_REQUEST_TYPES; t++) {
+	    h = &lat[i][t];
+	    if (h->n == 0)
+		continue;
+	    printf("%2d%12s%8lu%8.0f%8llu%8llu%9llu%10llu\n",
+		   i, request_names[t], h->n, h->sum/h->n,
+		   hist_percentile(h, 0.50),
+		   hist_percentile(h, 0.99),
+		   hist_percentile(h, 0.999),
+		   h->max);
+	}
+    }
+}
+
+/*
+ * write_latency_csv - writes every non-empty histogram bucket as a
+ *    "trace,file,request,lo,hi,count" row
+ */
+static void write_latency_csv(char *csvfile, int n, char **tracefiles,
+			      hist_t (*lat)[NUM_REQUEST_TYPES])
+{
+    FILE *fp;
+    char prefix[MAXLINE];
+    int i, t;
+
+    if ((fp = fopen(csvfile, "w")) == NULL)
+	unix_error("Could not open latency CSV file");
+    fprintf(fp, "trace,file,request,lo_cycles,hi_cycles,count\n");
+    for (i = 0; i < n; i++)
+	for (t = 0; t < NUM_REQUEST_TYPES; t++) {
+	    snprintf(prefix, MAXLINE, "%d,%s,%s", i, tracefiles[i], request_names[t]);
+	    hist_write_csv(&lat[i][t], fp, prefix);
+	}
+    fclose(fp);
+}
+
+/*
+ * wall_secs - Current monotonic time in seconds
+ */
+static double wall_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1019,14 +2549,32 @@ void malloc_error(int tracenum, int opnum, const char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValLsdSKMX] [-f <file>] [-t <dir>] [-T <n>] [-C <csv>]\n"
+	    "               [-p <fit>] [-F <csv> [-I <n>]] [-H <MB>] [-c <n>] [-P <h>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-c <n>     Check the whole heap every n requests, and the blocks\n"
+	    "\t           each request changed after the rest.\n");
+    fprintf(stderr, "\t-C <csv>   Write the -L latency histograms to <csv>.\n");
+    fprintf(stderr, "\t-d         Defer coalescing in mm.c through quick lists.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F <csv>   Write a fragmentation timeline to <csv> (MM_EVENTS builds).\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <MB>    Let the heap grow to <MB> megabytes (%d).\n", MAX_HEAP >> 20);
+    fprintf(stderr, "\t-M         Check validity with mm_memalign at alignments up to %d.\n", MEMALIGN_MAX);
+    fprintf(stderr, "\t-X         Check validity with mm_malloc_flags and the MM_LINE_xxx flags.\n");
+    fprintf(stderr, "\t-K         Keep payloads of up to %d bytes within a cache line.\n", MM_CACHE_LINE);
+    fprintf(stderr, "\t-I <n>     Snapshot the -F timeline every n requests (%d).\n", TIMELINE_EVERY);
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-S         Time the size class lookups of mm.c on the traces.\n");
+    fprintf(stderr, "\t-P <h>     Profile the traces, write suggested size classes to <h>.\n");
+    fprintf(stderr, "\t-p <fit>   Placement policy: first, next, best, good or seg (default),\n"
+	    "\t           or all to compare them.\n");
+    fprintf(stderr, "\t-L         Print latency percentiles of every request type.\n");
+    fprintf(stderr, "\t-s         Stream traces instead of loading them (no payload checks).\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Also replay each trace on n threads at once.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
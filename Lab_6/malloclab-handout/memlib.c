@@ -2,7 +2,17 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ * The heap is a virtual range of mem_heap_limit() bytes reserved with
+ * no access rights. mem_sbrk commits it in MEM_COMMIT steps as the brk
+ * climbs, so a large limit costs nothing until the heap gets there.
+ *
+ * Besides the sbrk heap it models mmap: mem_map, mem_unmap and
+ * mem_remap hand out page-aligned pieces of a second region of
+ * MAX_MAP bytes (or of the heap limit, if that is larger), so blocks
+ * placed there still have known bounds.
  */
+#define _GNU_SOURCE         /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,6 +20,8 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
@@ -18,20 +30,87 @@
 char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_peak_brk;   /* highest mem_brk since the last reset */
+static char *mem_commit_brk; /* end of the committed (read/write) part of the heap */
+static size_t mem_limit = MAX_HEAP; /* bytes of address space reserved for the heap */
+static char *mem_reserved;   /* the reservation, which starts below mem_start_brk with THP */
+static size_t mem_reserved_len;
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER; /* serializes mem_sbrk and mem_map */
+
+/* An unmapped stretch of the mapping region */
+typedef struct extent {
+    char *lo;
+    size_t len;
+    struct extent *next;
+} extent_t;
+
+static char *map_start;       /* first byte of the mapping region */
+static char *map_max_addr;    /* one past its last byte */
+static size_t map_len;        /* its size */
+static char *map_top;         /* end of the highest mapping since the last reset */
+static extent_t *map_free;    /* unmapped extents in address order */
+static size_t map_bytes;      /* bytes mapped right now */
+static int map_holes;         /* has mem_remap left pages of the region unmapped? */
+static size_t peak_footprint; /* most heap plus mapped bytes since the last reset */
+
+static void *map_take(size_t len);
+static void map_give(char *lo, size_t len);
+static void map_reset(void);
+static void note_footprint(void);
+
+/*
+ * mem_set_heap_limit - set the most bytes the heap can grow to;
+ *    takes effect at the next mem_init
+ */
+void mem_set_heap_limit(size_t bytes)
+{
+    mem_limit = (bytes + MEM_COMMIT - 1) & ~((size_t)MEM_COMMIT - 1);
+}
+
+/*
+ * mem_heap_limit - the most bytes the heap can grow to
+ */
+size_t mem_heap_limit()
+{
+    return mem_limit;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* reserve the address space we will use to model the available VM;
+       with THP it is aligned so the kernel can back it with huge pages */
+    mem_reserved_len = mem_limit + (MEM_THP ? MEM_COMMIT : 0);
+    mem_reserved = mmap(NULL, mem_reserved_len, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_reserved == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
+    mem_start_brk = (char *)(((uintptr_t)mem_reserved + MEM_COMMIT - 1) &
+			     ~((uintptr_t)MEM_COMMIT - 1));
+#if MEM_THP
+    madvise(mem_start_brk, mem_limit, MADV_HUGEPAGE);
+#endif
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
+    mem_max_addr = mem_start_brk + mem_limit; /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_peak_brk = mem_start_brk;
+    mem_commit_brk = mem_start_brk;           /* and none of it is committed */
+
+    /* the mapping region is reserved without swap; pages appear on first touch */
+    map_len = mem_limit > MAX_MAP ? mem_limit : MAX_MAP;
+    map_start = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map_start == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
+	exit(1);
+    }
+    map_max_addr = map_start + map_len;
+    map_top = map_start;
+    map_reset();
 }
 
 /* 
@@ -39,7 +118,8 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_reserved, mem_reserved_len);
+    munmap(map_start, map_len);
 }
 
 /*
@@ -48,26 +128,108 @@ void mem_deinit(void)
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    mem_peak_brk = mem_start_brk;
+    peak_footprint = 0;
+    map_reset();
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    A negative incr shrinks the heap and gives the whole pages past
+ *    the new brk back to the OS, like sbrk does. Returns the old brk
+ *    either way. Safe to call from several threads at once.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk, *commit;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    pthread_mutex_lock(&mem_lock);
+    old_brk = mem_brk;
+    if (((mem_brk + incr) < mem_start_brk) || ((mem_brk + incr) > mem_max_addr)) {
+	pthread_mutex_unlock(&mem_lock);
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
+
+    /* commit whole MEM_COMMIT steps of the reservation as the brk passes them */
+    if (mem_brk + incr > mem_commit_brk) {
+	commit = (char *)(((uintptr_t)mem_brk + incr + MEM_COMMIT - 1) &
+			  ~((uintptr_t)MEM_COMMIT - 1));
+	if (commit > mem_max_addr)
+	    commit = mem_max_addr;
+	if (mprotect(mem_commit_brk, commit - mem_commit_brk, PROT_READ | PROT_WRITE) < 0) {
+	    pthread_mutex_unlock(&mem_lock);
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit memory...\n");
+	    return (void *)-1;
+	}
+	mem_commit_brk = commit;
+    }
     mem_brk += incr;
+    if (mem_brk > mem_peak_brk)
+	mem_peak_brk = mem_brk;
+    note_footprint();
+    pthread_mutex_unlock(&mem_lock);
+    if (incr < 0)
+	mem_release(old_brk + incr, -incr);
     return (void *)old_brk;
 }
 
+/*
+ * mem_release - Give the whole pages inside [lo, lo+len) back to the
+ *    OS. They stay part of the heap but read as zero on the next touch,
+ *    which faults in a fresh page. Returns the number of bytes released.
+ */
+size_t mem_release(void *lo, size_t len)
+{
+    uintptr_t page = mem_pagesize();
+    uintptr_t start = ((uintptr_t)lo + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)lo + len) & ~(page - 1);
+
+    if (end <= start)
+	return 0;
+    if (madvise((void *)start, end - start, MADV_DONTNEED) < 0)
+	return 0;
+    return end - start;
+}
+
+/*
+ * mem_resident - Bytes of the heap below the brk and of the mapping
+ *    region that are backed by RAM right now, i.e. the allocator's
+ *    share of the resident set size
+ */
+size_t mem_resident(void)
+{
+    static unsigned char *vec = NULL;
+    static size_t vec_len = 0;
+    uintptr_t page = mem_pagesize();
+    uintptr_t start = (uintptr_t)mem_start_brk & ~(page - 1);
+    size_t npages, i, resident = 0;
+
+    size_t map_pages;
+
+    pthread_mutex_lock(&mem_lock);
+    npages = ((uintptr_t)mem_brk - start + page - 1) / page;
+    map_pages = (map_top - map_start) / page;
+    if (npages + map_pages > vec_len) {
+	free(vec);
+	vec_len = npages + map_pages;
+	if ((vec = (unsigned char *)malloc(vec_len)) == NULL) {
+	    fprintf(stderr, "mem_resident: malloc error\n");
+	    exit(1);
+	}
+    }
+    if (npages > 0 && mincore((void *)start, npages * page, vec) == 0)
+	for (i = 0; i < npages; i++)
+	    resident += vec[i] & 1;
+    if (map_pages > 0 && mincore(map_start, map_pages * page, vec) == 0)
+	for (i = 0; i < map_pages; i++)
+	    resident += vec[i] & 1;
+    pthread_mutex_unlock(&mem_lock);
+    return resident * page;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -92,6 +254,46 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_peak_heapsize() - returns the largest the heap has been since the
+ *    last mem_reset_brk, in bytes
+ */
+size_t mem_peak_heapsize()
+{
+    return (size_t)(mem_peak_brk - mem_start_brk);
+}
+
+/*
+ * mem_peak_footprint() - returns the most memory the heap and the
+ *    mappings have held together since the last mem_reset_brk, in bytes
+ */
+size_t mem_peak_footprint()
+{
+    return peak_footprint;
+}
+
+/*
+ * mem_mapped() - returns the bytes currently mapped with mem_map
+ */
+size_t mem_mapped()
+{
+    return map_bytes;
+}
+
+/*
+ * mem_map_lo, mem_map_hi - return the first and last byte of the
+ *    region that mem_map hands out pages of
+ */
+void *mem_map_lo()
+{
+    return (void *)map_start;
+}
+
+void *mem_map_hi()
+{
+    return (void *)(map_max_addr - 1);
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -99,3 +301,210 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_map - simple model of an anonymous mmap. Returns len bytes
+ *    (rounded up to whole pages) of zeroed, page-aligned memory, or
+ *    NULL if the mapping region has no room. Thread safe.
+ */
+void *mem_map(size_t len)
+{
+    void *p;
+
+    len = (len + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    pthread_mutex_lock(&mem_lock);
+    if ((p = map_take(len)) != NULL) {
+	map_bytes += len;
+	note_footprint();
+    }
+    pthread_mutex_unlock(&mem_lock);
+    return p;
+}
+
+/*
+ * mem_unmap - model of munmap: give back the mapping of len bytes at p.
+ *    Its pages are released at once.
+ */
+void mem_unmap(void *p, size_t len)
+{
+    len = (len + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    mem_release(p, len);
+    pthread_mutex_lock(&mem_lock);
+    map_give((char *)p, len);
+    map_bytes -= len;
+    pthread_mutex_unlock(&mem_lock);
+}
+
+/*
+ * mem_remap - model of mremap(MREMAP_MAYMOVE): resize the mapping of
+ *    old_len bytes at p to new_len bytes and return where it now lives,
+ *    or NULL (leaving it alone) if there is no room. A mapping grows in
+ *    place when the pages after it are free. Otherwise its pages are
+ *    moved to a new address with mremap, which changes page tables but
+ *    copies no data, and the hole they leave is mapped afresh.
+ */
+void *mem_remap(void *p, size_t old_len, size_t new_len)
+{
+    size_t page = mem_pagesize();
+    char *q = (char *)p;
+    extent_t *e, **link;
+
+    old_len = (old_len + page - 1) & ~(page - 1);
+    new_len = (new_len + page - 1) & ~(page - 1);
+
+    /* Shrinking just unmaps the tail */
+    if (new_len <= old_len) {
+	if (new_len < old_len)
+	    mem_unmap(q + new_len, old_len - new_len);
+	return p;
+    }
+
+    pthread_mutex_lock(&mem_lock);
+
+    /* Grow in place into a free extent that starts right at the end */
+    for (link = &map_free; (e = *link) != NULL && e->lo < q + old_len; link = &e->next)
+	;
+    if (e != NULL && e->lo == q + old_len && e->len >= new_len - old_len) {
+	e->lo += new_len - old_len;
+	e->len -= new_len - old_len;
+	if (e->len == 0) {
+	    *link = e->next;
+	    free(e);
+	}
+	if (q + new_len > map_top)
+	    map_top = q + new_len;
+    }
+
+    /* Or move the pages somewhere with room for all of them */
+    else {
+	if ((q = map_take(new_len)) == NULL) {
+	    pthread_mutex_unlock(&mem_lock);
+	    return NULL;
+	}
+	if (mremap(p, old_len, old_len, MREMAP_MAYMOVE | MREMAP_FIXED, q) == MAP_FAILED) {
+	    memcpy(q, p, old_len);
+	    mem_release(p, old_len);
+	    map_give((char *)p, old_len);
+	}
+	/* The data is safe at q, but the hole at p has no pages, so it
+	   is not handed out again until map_reset maps it afresh */
+	else if (mmap(p, old_len, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE,
+		      -1, 0) == MAP_FAILED) {
+	    fprintf(stderr, "ERROR: mem_remap could not refill the old mapping...\n");
+	    map_holes = 1;
+	}
+	else
+	    map_give((char *)p, old_len);
+    }
+
+    map_bytes += new_len - old_len;
+    note_footprint();
+    pthread_mutex_unlock(&mem_lock);
+    return q;
+}
+
+/*
+ * map_take - Carve len bytes out of the first free extent big enough;
+ *    mem_lock must be held
+ */
+static void *map_take(size_t len)
+{
+    extent_t *e, **link;
+    char *p;
+
+    for (link = &map_free; (e = *link) != NULL; link = &e->next) {
+	if (e->len < len)
+	    continue;
+	p = e->lo;
+	e->lo += len;
+	e->len -= len;
+	if (e->len == 0) {
+	    *link = e->next;
+	    free(e);
+	}
+	if (p + len > map_top)
+	    map_top = p + len;
+	return p;
+    }
+    return NULL;
+}
+
+/*
+ * map_give - Return [lo, lo+len) to the free extents, merging it with
+ *    its neighbors; mem_lock must be held
+ */
+static void map_give(char *lo, size_t len)
+{
+    extent_t *e, *prev = NULL, *n;
+
+    for (e = map_free; e != NULL && e->lo < lo; prev = e, e = e->next)
+	;
+
+    /* Merge with the extent before, the one after, or both */
+    if (prev != NULL && prev->lo + prev->len == lo) {
+	prev->len += len;
+	if (e != NULL && lo + len == e->lo) {
+	    prev->len += e->len;
+	    prev->next = e->next;
+	    free(e);
+	}
+	return;
+    }
+    if (e != NULL && lo + len == e->lo) {
+	e->lo = lo;
+	e->len += len;
+	return;
+    }
+
+    if ((n = (extent_t *)malloc(sizeof(extent_t))) == NULL) {
+	fprintf(stderr, "map_give: malloc error\n");
+	exit(1);
+    }
+    n->lo = lo;
+    n->len = len;
+    n->next = e;
+    if (prev != NULL)
+	prev->next = n;
+    else
+	map_free = n;
+}
+
+/*
+ * map_reset - Unmap everything: one free extent spans the region again
+ *    and every page touched since the last reset is released (holes
+ *    mem_remap could not refill are mapped afresh with the rest)
+ */
+static void map_reset(void)
+{
+    extent_t *e;
+
+    while ((e = map_free) != NULL) {
+	map_free = e->next;
+	free(e);
+    }
+    if (!map_holes)
+	mem_release(map_start, map_top - map_start);
+    else if (mmap(map_start, map_len, PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE,
+		  -1, 0) == MAP_FAILED) {
+	fprintf(stderr, "map_reset: mmap error\n");
+	exit(1);
+    }
+    map_holes = 0;
+    map_top = map_start;
+    map_bytes = 0;
+    map_give(map_start, map_len);
+}
+
+/*
+ * note_footprint - Update the peak of heap plus mapped bytes;
+ *    mem_lock must be held
+ */
+static void note_footprint(void)
+{
+    size_t now = (mem_brk - mem_start_brk) + map_bytes;
+
+    if (now > peak_footprint)
+	peak_footprint = now;
+}
@@ -1,11 +1,25 @@
 #include <unistd.h>
+#include <stdint.h>
 
+void mem_set_heap_limit(size_t bytes);
+size_t mem_heap_limit(void);
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
+size_t mem_release(void *lo, size_t len);
+size_t mem_resident(void);
+size_t mem_peak_footprint(void);
 size_t mem_pagesize(void);
 
+void *mem_map(size_t len);
+void mem_unmap(void *p, size_t len);
+void *mem_remap(void *p, size_t old_len, size_t new_len);
+size_t mem_mapped(void);
+void *mem_map_lo(void);
+void *mem_map_hi(void);
+
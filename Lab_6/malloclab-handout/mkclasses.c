@@ -0,0 +1,113 @@
+/*
+ * mkclasses.c - Generate the size class lookup tables of mm.c from a
+ *     class spec (size_classes.h unless CLASS_SPEC names another)
+ *
+ * usage: mkclasses > class_table.h
+ *
+ * For every request size up to TABLE_MAX the table holds the block
+ * size mm.c rounds it to, its slab class, and the largest class a
+ * block of that many usable bytes can serve, so mm_malloc gets all of
+ * them with one indexed load instead of a division and a search of
+ * the classes. It must be built with the CFLAGS of mm.c, since the
+ * block sizes depend on ALIGNMENT.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#ifndef CLASS_SPEC
+#define CLASS_SPEC "size_classes.h"
+#endif
+#include CLASS_SPEC
+
+#define TABLE_MAX 256  /* largest request size in the table */
+#define OVERHEAD  4    /* header bytes of an allocated block, as in mm.c */
+#define MIN_BLOCK (ALIGNMENT > 16 ? ALIGNMENT : 16) /* smallest block, as in mm.c */
+#define NO_CLASS  0xFF /* no slab class */
+
+#define SLOT(s) s,
+static const int slots[] = { SIZE_CLASSES(SLOT) };
+#define NCLASSES ((int)(sizeof(slots) / sizeof(slots[0])))
+
+/*
+ * block_size - Block size of a request of size bytes (adjust_size)
+ */
+static int block_size(int size)
+{
+    if (size <= MIN_BLOCK - OVERHEAD)
+	return MIN_BLOCK;
+    return ALIGNMENT * ((size + OVERHEAD + ALIGNMENT - 1) / ALIGNMENT);
+}
+
+/*
+ * spec_error - Reject the spec
+ */
+static void spec_error(const char *msg, int slot)
+{
+    fprintf(stderr, "mkclasses: %s: %s (slot %d)\n", CLASS_SPEC, msg, slot);
+    exit(1);
+}
+
+int main(void)
+{
+    int i, c, fits, size, slab_max;
+
+    /* The slots must be usable as they are */
+    if (CLASS_ALIGNMENT != ALIGNMENT)
+	spec_error("made for another ALIGNMENT", CLASS_ALIGNMENT);
+    if (NCLASSES >= NO_CLASS)
+	spec_error("too many classes", NCLASSES);
+    for (i = 0; i < NCLASSES; i++) {
+	if (slots[i] <= 0 || slots[i] % ALIGNMENT != 0)
+	    spec_error("slot is not a multiple of ALIGNMENT", slots[i]);
+	if (i > 0 && slots[i] <= slots[i - 1])
+	    spec_error("slots are not in ascending order", slots[i]);
+    }
+    slab_max = slots[NCLASSES - 1];
+    if (slab_max > TABLE_MAX)
+	spec_error("slot is larger than TABLE_MAX", slab_max);
+
+    printf("/*\n"
+	   " * class_table.h - Size class lookup tables of mm.c, generated by\n"
+	   " *     mkclasses from %s with ALIGNMENT %d; do not edit\n"
+	   " */\n", CLASS_SPEC, ALIGNMENT);
+    printf("#ifndef __CLASS_TABLE_H_\n#define __CLASS_TABLE_H_\n\n");
+    printf("#include <stdint.h>\n\n");
+    printf("#define SLAB_CLASSES    %d\n", NCLASSES);
+    printf("#define SLAB_MAX        %d\n", slab_max);
+    printf("#define SLAB_WARMUP     %d\n", CLASS_WARMUP);
+    printf("#define TABLE_MAX       %d\n", TABLE_MAX);
+    printf("#define TABLE_ALIGNMENT %d\n", ALIGNMENT);
+    printf("#define TABLE_OVERHEAD  %d\n", OVERHEAD);
+    printf("#define TABLE_MIN_BLOCK %d\n", MIN_BLOCK);
+    printf("#define NO_CLASS        %d\n\n", NO_CLASS);
+
+    printf("typedef struct {\n"
+	   "    uint16_t asize; /* block size of a request of this many bytes */\n"
+	   "    uint8_t slab;   /* its slab class, or NO_CLASS above SLAB_MAX */\n"
+	   "    uint8_t fits;   /* largest class this many usable bytes serve, or NO_CLASS */\n"
+	   "} size_class_t;\n\n");
+
+    printf("static const uint32_t slab_slot[SLAB_CLASSES] = {");
+    for (i = 0; i < NCLASSES; i++)
+	printf("%s%d", i ? ", " : " ", slots[i]);
+    printf(" };\n\n");
+
+    /*
+     * A block with more than ALIGNMENT bytes to spare over SLAB_MAX is
+     * too big to hand out for the largest class
+     */
+    printf("static const size_class_t size_table[TABLE_MAX + 1] = {\n");
+    for (size = 0, c = 0, fits = NO_CLASS; size <= TABLE_MAX; size++) {
+	while (c < NCLASSES && slots[c] < size)
+	    c++;
+	if (c < NCLASSES && slots[c] == size)
+	    fits = c;
+	if (size >= slab_max + ALIGNMENT)
+	    fits = NO_CLASS;
+	printf("    { %3d, %3d, %3d }, /* %d */\n", block_size(size),
+	       c < NCLASSES ? c : NO_CLASS, fits, size);
+    }
+    printf("};\n\n#endif /* __CLASS_TABLE_H_ */\n");
+    return 0;
+}
@@ -1,20 +1,25 @@
-/* 
- * mm-implicit.c -  Simple allocator based on implicit free lists, 
- *                  first fit placement, and boundary tag coalescing. 
+/*
+ * mm-seglist.c -  Allocator based on segregated explicit free lists,
+ *                 first fit placement within a size class, and
+ *                 boundary tag coalescing.
  *
- * Each block has header and footer of the form:
- * 
- *      31                     3  2  1  0 
+ * Each block has a header of the form:
+ *
+ *      31                     3  2  1  0
+ *      -----------------------------------
+ *     | s  s  s  s  ... s  s  s  0 pa  a/f
  *      -----------------------------------
- *     | s  s  s  s  ... s  s  s  0  0  a/f
- *      ----------------------------------- 
- * 
- * where s are the meaningful size bits and a/f is set 
- * iff the block is allocated. The list has the following form:
+ *
+ * where s are the meaningful size bits, a/f is set iff the block
+ * is allocated and pa is set iff the previous block is allocated.
+ * Only free blocks carry a matching footer; coalesce needs the
+ * footer of the previous block only when pa says it is free, so
+ * allocated blocks get to use that word as payload. The list has
+ * the following form:
  *
  * begin                                                          end
- * heap                                                           heap  
- *  -----------------------------------------------------------------   
+ * heap                                                           heap
+ *  -----------------------------------------------------------------
  * |  pad   | hdr(8:a) | ftr(8:a) | zero or more usr blks | hdr(8:a) |
  *  -----------------------------------------------------------------
  *          |       prologue      |                       | epilogue |
@@ -22,13 +27,126 @@
  *
  * The allocated prologue and epilogue blocks are overhead that
  * eliminate edge conditions during coalescing.
+ *
+ * Payloads are aligned to ALIGNMENT bytes (8, 16, 32 or 64, set in
+ * config.h). Every block size is a multiple of it, and the pad and the
+ * prologue are ALIGNMENT - 4 and ALIGNMENT bytes, so the first payload
+ * lands on an ALIGNMENT boundary and every later one follows suit.
+ * mm_memalign goes beyond that for single blocks.
+ *
+ * Free blocks are additionally linked into one of NUM_BINS doubly
+ * linked free lists. Below LARGE_MIN there is one bin per power of two,
+ * bin i holding the sizes in [2^(i+4), 2^(i+5)). From LARGE_MIN up each
+ * power of two is split TLSF-style into 2^SL_BITS equal bins, so a large
+ * bin never spans more than 1/8 of its sizes. A bitmap with one bit per
+ * non-empty bin finds the next bin with a guaranteed fit in O(1).
+ * The links live in the first two words of the free payload:
+ *
+ *      -------------------------------------------------
+ *     | hdr(s:f) | pred | succ |  ...unused...  | ftr(s:f) |
+ *      -------------------------------------------------
+ *
+ * To fit both links into the 16 byte minimum block they are stored
+ * as 32-bit offsets from the start of the heap, counted in doublewords,
+ * rather than as raw pointers; offset 0 (the alignment pad) means NULL.
+ * That lets the heap span up to HEAP_SPAN (32 GB) while a block in it
+ * keeps its 4 byte header, which caps its payload at BLOCK_MAX.
+ * Coalescing stops short of SIZE_MAX32, so two free blocks are only
+ * ever neighbors when together they would not fit a header.
+ * mm_malloc, mm_free and coalesce only ever touch free blocks.
+ *
+ * find_fit places a block by segregated fit unless mm_set_fit picks
+ * another policy. First, next, best and good fit treat the bins from
+ * the request's own upward as one list, so they can be compared on
+ * the same heap layout; mm_fitstats reports how many free blocks each
+ * search had to look at.
+ *
+ * Requests of up to SLAB_MAX bytes are served by a slab front end
+ * once enough of them are live. A slab run is an ordinary allocated
+ * block of SLAB_RUN bytes whose payload starts on a SLAB_RUN boundary:
+ *
+ *      -------------------------------------------------------
+ *     | slab_t: links, counts, free bitmap | slot | slot | ... |
+ *      -------------------------------------------------------
+ *     ^ SLAB_RUN aligned
+ *
+ * Slots carry no header. slab_map records which heap pages hold a run,
+ * so mm_free can tell a slot from a block with one table lookup and
+ * find its run by rounding the pointer down.
+ *
+ * The slot sizes of the slab classes come from a class spec, by default
+ * size_classes.h, which mkclasses turns into class_table.h at build
+ * time. Its size_table gives the block size and slab class of every
+ * request of up to TABLE_MAX bytes in one load; larger requests are
+ * rounded with a mask and binned by size_bin's count-leading-zeros.
+ *
+ * The allocator is thread-safe. All of the above (free lists, bitmap,
+ * slab runs) lives in an arena_t, and there are NUM_ARENAS of them;
+ * each thread is bound to one arena round-robin and allocates only
+ * from it, under that arena's lock. An arena grows the heap in place
+ * while it owns the top of the heap. Otherwise it starts a new segment
+ * on the next page, laid out like the heap above (pad, blocks,
+ * epilogue). arena_map records which arena owns each heap page.
+ *
+ *   - A thread keeps up to TCACHE_MAX freed small blocks of its own
+ *     arena per size in a thread-local cache. These blocks stay
+ *     allocated, so mm_malloc and mm_free can hand them out again
+ *     without taking any lock.
+ *   - A block freed by a thread of another arena is pushed lock-free
+ *     onto the owner's remote stack. The owner frees the blocks on that
+ *     stack the next time it takes its lock.
+ *
+ * With a single thread only arena 0 is ever used, so the heap stays one
+ * segment.
+ *
+ * mm_set_defer turns on deferred coalescing. A freed block of up to
+ * QUICK_MAX bytes then stays allocated on a quick list for its exact
+ * size, where the next request of that size finds it in O(1). The
+ * quick lists are only coalesced into the free lists as a batch, when
+ * a fit search comes up empty or they hold more than QUICK_BUDGET
+ * blocks, so alloc/free churn skips the merge and re-split.
+ *
+ * mm_set_lines turns on line-aware placement: a payload of up to
+ * CACHE_LINE bytes is never placed across a cache line boundary. A fit
+ * that would straddle one is moved up to the next line instead, and
+ * slabs only serve the classes whose slots divide a line. Callers can
+ * also ask for this, or for lines of a block's own, with mm_malloc_flags.
+ *
+ * Freed memory goes back to the OS in two ways. A free block of more
+ * than TRIM_THRESHOLD bytes at the top of the heap is cut down to
+ * TRIM_KEEP and the brk moved back down. A free block of RELEASE_MIN
+ * bytes or more anywhere else keeps its place in the heap, but the
+ * whole pages inside it are released with madvise and only fault back
+ * in when the block is used again. That does not happen at once: the
+ * block waits in one of its arena's RELEASE_SLOTS until RELEASE_DELAY
+ * more frees have reached the arena, and its pages go only if nothing
+ * took it in the meantime, so memory that is about to be reused keeps
+ * them.
+ *
+ * Requests of HUGE_MIN bytes or more bypass the arenas altogether and
+ * get a mapping of their own from mem_map. Their header is a 64-bit
+ * word, so only they can be larger than BLOCK_MAX:
+ *
+ *      ----------------------------------
+ *     | hdr(len:a)     | payload ...     |
+ *      ----------------------------------
+ *     ^ page aligned   ^ bp
+ *
+ * The header records the length of the whole mapping, so mm_free can
+ * unmap it at once, and mm_realloc resizes it with mem_remap, which
+ * moves pages rather than copying bytes. A pointer inside the mapping
+ * region is recognized by its address alone.
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <memory.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -47,33 +165,86 @@ team_t team = {
 //
 // These correspond to the material in Figure 9.43 of the text
 // The macros have been turned into C++ inline functions to
-// make debugging code easier.
+// make debugging code easier. The Makefile builds with -O0, where gcc
+// calls even inline functions, so they are forced inline as the macros
+// were; on the per-request paths those calls cost more than the work.
 //
 /////////////////////////////////////////////////////////////////////////////
-#define WSIZE       4       /* word size (bytes) */  
+#define ALWAYS_INLINE __attribute__((always_inline))
+#define WSIZE       4       /* word size (bytes) */
 #define DSIZE       8       /* doubleword size (bytes) */
 #define CHUNKSIZE  (1<<12)  /* initial heap size (bytes) */
-#define OVERHEAD    8       /* overhead of header and footer (bytes) */
+#define OVERHEAD    4       /* overhead of an allocated block's header (bytes) */
+#define MIN_BLOCK  (ALIGNMENT > 2*DSIZE ? ALIGNMENT : 2*DSIZE) /* smallest free block: header, both links, footer */
+#define LARGE_SHIFT 10      /* log2 of LARGE_MIN */
+#define LARGE_MIN  (1<<LARGE_SHIFT) /* smallest block kept in the fine grained bins */
+#define SMALL_BINS (LARGE_SHIFT-4)  /* power-of-two bins for 16 up to LARGE_MIN */
+#define SL_BITS     3       /* each large power of two is split into 2^SL_BITS bins */
+#define NUM_BINS   (SMALL_BINS + ((32-LARGE_SHIFT) << SL_BITS))
+#define BIN_WORDS  ((NUM_BINS + 63) / 64) /* 64-bit words in the non-empty bin bitmap */
+#define FIT_PROBES  16      /* blocks compared for best fit within a large bin */
+#define GOOD_SHIFT  3       /* good fit accepts waste up to 1/2^GOOD_SHIFT of the request */
+
+#define MAP_PAGE      (1<<12)  /* granularity of slab_map and arena_map */
+#define SLAB_RUN      MAP_PAGE /* block size and alignment of a slab run */
+#define SLAB_MAPWORDS 8        /* 64-bit free bitmap words, enough for 8 byte slots */
+#define SLAB_TRACK_MAX (SLAB_MAX + ALIGNMENT) /* largest block size counted toward SLAB_WARMUP */
+
+#define NUM_ARENAS    8        /* independent heaps that threads are spread over */
+#define ARENA_CHUNK  (1<<16)   /* smallest new segment an arena starts (bytes) */
+#define TCACHE_MAX    16       /* cached free blocks per size in each thread */
 
-static inline int MAX(int x, int y) {
+#define QUICK_MAX     256      /* largest block that waits on a quick list */
+#define QUICK_CLASSES (QUICK_MAX/ALIGNMENT + 1) /* one list per block size */
+#define QUICK_BUDGET  512      /* blocks on an arena's quick lists before a batch coalesce */
+#define CACHE_LINE    MM_CACHE_LINE /* line size line-aware placement works with (mm.h) */
+#define TOUCH_MAX     8        /* blocks mm_checkrecent checks before it checks the whole heap */
+
+#define TRIM_THRESHOLD (1<<17) /* free bytes at the top of the heap before the brk moves down */
+#define TRIM_KEEP      CHUNKSIZE /* free bytes left at the top after a trim */
+#define RELEASE_MIN    (1<<20) /* free blocks this big give their pages back to the OS */
+#define RELEASE_DELAY  256     /* frees of its arena a free block waits out before its release */
+#define RELEASE_SLOTS  8       /* free blocks an arena keeps waiting at once */
+#define HUGE_MIN       (1<<17) /* requests this big get a mapping of their own */
+#define BLOCK_MAX ((1u<<31) - (1<<16)) /* largest payload of a block in the heap */
+#define SIZE_MAX32 0xFFFFFFF8u           /* largest size a 4 byte header can hold */
+#define HEAP_SPAN ((size_t)DSIZE << 32)  /* heap bytes the link offsets can reach */
+#define HUGE_PAD  (ALIGNMENT > DSIZE ? ALIGNMENT : DSIZE) /* mapping start to huge payload */
+
+#if ALIGNMENT < 8 || ALIGNMENT > 64 || (ALIGNMENT & (ALIGNMENT - 1)) != 0
+#error "ALIGNMENT must be 8, 16, 32 or 64"
+#endif
+
+// SLAB_MAX, SLAB_CLASSES, SLAB_WARMUP and the size lookup tables, made by
+// mkclasses from the class spec; they must agree with the block layout
+#include "class_table.h"
+#if TABLE_ALIGNMENT != ALIGNMENT || TABLE_OVERHEAD != OVERHEAD || TABLE_MIN_BLOCK != MIN_BLOCK
+#error "class_table.h is stale, run make clean"
+#endif
+
+static inline ALWAYS_INLINE int MAX(int x, int y) {
   return x > y ? x : y;
 }
 
+static inline ALWAYS_INLINE int MIN(int x, int y) {
+  return x < y ? x : y;
+}
+
 //
-// Pack a size and allocated bit into a word
-// We mask of the "alloc" field to insure only
-// the lower bit is used
+// Pack a size, previous-allocated bit and allocated bit into a word
+// We mask of the "alloc" fields to insure only
+// the lower two bits are used
 //
-// combines a size and an allocate bit and returns a value that can be stored in a header or footer
-static inline uint32_t PACK(uint32_t size, int alloc) {
-  return ((size) | (alloc & 0x1));
+// combines a size and the allocate bits and returns a value that can be stored in a header or footer
+static inline ALWAYS_INLINE uint32_t PACK(uint32_t size, int prev_alloc, int alloc) {
+  return ((size) | ((prev_alloc & 0x1) << 1) | (alloc & 0x1));
 }
 
 //
 // Read and write a word at address p
 //
-static inline uint32_t GET(void *p) { return  *(uint32_t *)p; }
-static inline void PUT( void *p, uint32_t val)
+static inline ALWAYS_INLINE uint32_t GET(void *p) { return  *(uint32_t *)p; }
+static inline ALWAYS_INLINE void PUT( void *p, uint32_t val)
 {
   *((uint32_t *)p) = val;
 }
@@ -81,35 +252,59 @@ static inline void PUT( void *p, uint32_t val)
 //
 // Read the size and allocated fields from address p
 //
-static inline uint32_t GET_SIZE( void *p )  { 
+static inline ALWAYS_INLINE uint32_t GET_SIZE( void *p )  {
   return GET(p) & ~0x7;
 }
 
-static inline int GET_ALLOC( void *p  ) {
+static inline ALWAYS_INLINE int GET_ALLOC( void *p  ) {
   return GET(p) & 0x1;
 }
 
+static inline ALWAYS_INLINE int GET_PREV_ALLOC( void *p ) {
+  return (GET(p) >> 1) & 0x1;
+}
+
+//
+// Set or clear the previous-allocated bit of the header at address p
+// The block may be allocated, and its owner reads its header without
+// the arena lock (GET_SIZE_ATOMIC), so the bit is flipped atomically.
+//
+static inline ALWAYS_INLINE void SET_PREV_ALLOC( void *p ) {
+  __atomic_fetch_or((uint32_t *)p, 0x2, __ATOMIC_RELAXED);
+}
+static inline ALWAYS_INLINE void CLEAR_PREV_ALLOC( void *p ) {
+  __atomic_fetch_and((uint32_t *)p, ~(uint32_t)0x2, __ATOMIC_RELAXED);
+}
+
+//
+// Read the size field of the header at address p without the arena lock
+//
+static inline ALWAYS_INLINE uint32_t GET_SIZE_ATOMIC( void *p ) {
+  return __atomic_load_n((uint32_t *)p, __ATOMIC_RELAXED) & ~0x7;
+}
+
 //
 // Given block ptr bp, compute address of its header and footer
 // The remaining macros operate on block pointers (denoted bp) that point to the first payload byte
 // Given a block pointer bp, the HDRP and FTRP macros (lines 20–21) return pointers to the block header and footer, respectively
-// 
-static inline void *HDRP(void *bp) {
+//
+static inline ALWAYS_INLINE void *HDRP(void *bp) {
 
   return ( (char *)bp) - WSIZE;
 }
-static inline void *FTRP(void *bp) {
+static inline ALWAYS_INLINE void *FTRP(void *bp) {
   return ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE);
 }
 
 //
 // Given block ptr bp, compute address of next and previous blocks
 //
-static inline void *NEXT_BLKP(void *bp) {
+static inline ALWAYS_INLINE void *NEXT_BLKP(void *bp) {
   return  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)));
 }
 
-static inline void* PREV_BLKP(void *bp){
+// only valid when the previous block is free, since only free blocks have a footer
+static inline ALWAYS_INLINE void* PREV_BLKP(void *bp){
   return  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)));
 }
 
@@ -118,52 +313,379 @@ static inline void* PREV_BLKP(void *bp){
 // Global Variables
 //
 // allocator uses a single private (static) global variable (heap_listp) that always points to the prologue block
-static char *heap_listp;  /* pointer to first block */  
-static char *last_fitbp;  /* pointer to the header of the last found fit block */
+static char *heap_listp;  /* pointer to first block */
+static char *heap_base;   /* first byte of the heap, origin for the link offsets */
+static char *huge_lo;     /* bounds of the region huge blocks are mapped from */
+static char *huge_hi;
+
+//
+// Free list links are 32-bit heap offsets in doublewords, 0 stands for NULL
+//
+static inline ALWAYS_INLINE char *OFF2PTR(uint32_t off) {
+  return off ? heap_base + (size_t)off * DSIZE : NULL;
+}
+static inline ALWAYS_INLINE uint32_t PTR2OFF(void *bp) {
+  return bp ? (uint32_t)(((char *)bp - heap_base) / DSIZE) : 0;
+}
+
+//
+// Given free block ptr bp, read and write its predecessor and successor
+// in the free list
+//
+static inline ALWAYS_INLINE char *PRED(void *bp) { return OFF2PTR(GET(bp)); }
+static inline ALWAYS_INLINE char *SUCC(void *bp) { return OFF2PTR(GET((char *)bp + WSIZE)); }
+static inline ALWAYS_INLINE void SET_PRED(void *bp, void *pred) { PUT(bp, PTR2OFF(pred)); }
+static inline ALWAYS_INLINE void SET_SUCC(void *bp, void *succ) { PUT((char *)bp + WSIZE, PTR2OFF(succ)); }
+
+//
+// Header at the start of every slab run
+//
+typedef struct {
+  uint32_t prev;                   /* heap offsets of the neighboring runs */
+  uint32_t next;                   /*   on this class's partial list       */
+  uint16_t class;                  /* slab class of every slot in the run */
+  uint16_t nslots;                 /* number of slots in the run */
+  uint16_t nfree;                  /* number of those still free */
+  uint16_t hint;                   /* no free slots in freemap words below this */
+  uint64_t freemap[SLAB_MAPWORDS]; /* bit i set iff slot i is free */
+} slab_t;
+
+//
+// A big free block waiting to give its pages back (see free_block)
+//
+typedef struct {
+  char *bp;                        /* the block, NULL if the slot is empty */
+  char *lo, *hi;                   /* the part of it not released yet */
+  unsigned long due;               /* frees count of its arena to release it at */
+} release_t;
+
+//
+// An arena is a complete allocator of its own: free lists, bitmap and
+// slab runs. Everything in it is guarded by its lock, except remote,
+// which other threads push onto with compare-and-swap.
+//
+typedef struct {
+  pthread_mutex_t lock;
+  int id;                                /* index in arenas[], as kept in arena_map */
+  char *free_lists[NUM_BINS];            /* heads of the segregated free lists */
+  uint64_t bin_bitmap[BIN_WORDS];        /* bit b set iff free_lists[b] is non-empty */
+  slab_t *slab_partial[SLAB_CLASSES];    /* runs with at least one free slot */
+  int slab_on[SLAB_CLASSES];             /* class has switched to slab runs */
+  int small_live[SLAB_TRACK_MAX/DSIZE + 1]; /* live small blocks by size/8 */
+  char *rover;                           /* where the next next-fit search starts */
+  char *quick[QUICK_CLASSES];            /* freed blocks awaiting coalescing, by size/ALIGNMENT */
+  int quick_count;                       /* blocks on all of them */
+  char *touched[TOUCH_MAX];              /* blocks changed since the last check */
+  int ntouched;                          /*   how many, TOUCH_MAX + 1 once they overflow */
+  mm_fitstats_t fit;                     /* probe counts of find_fit since mm_fitstats */
+  release_t pending[RELEASE_SLOTS];      /* big free blocks waiting to be released */
+  int npending;                          /*   how many of the slots are in use */
+  unsigned long frees;                   /* calls of free_block so far */
+  void *remote;                          /* blocks freed by other threads, linked through the payload */
+} arena_t;
+
+//
+// A thread's cache of freed small blocks, one stack per slab class,
+// linked through the first payload word. The blocks are still allocated
+// as far as the arena is concerned.
+//
+typedef struct {
+  unsigned epoch;                        /* heap_epoch the entries belong to */
+  void *head[SLAB_CLASSES];
+  int count[SLAB_CLASSES];
+} tcache_t;
+
+static arena_t arenas[NUM_ARENAS];
+static int arenas_ready;                 /* arena locks have been initialized */
+static unsigned next_arena;              /* round-robin counter for binding threads */
+static arena_t *tail_arena;              /* arena whose segment ends at the brk */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER; /* guards the brk and tail_arena */
+static unsigned heap_epoch;              /* bumped by mm_init, invalidates every tcache */
+static int fit_policy = MM_FIT_SEG;      /* placement policy chosen by mm_set_fit */
+static int next_policy = MM_FIT_SEG;     /*   and the one the next mm_init switches to */
+static int defer_coalesce;               /* freed small blocks wait on quick lists (mm_set_defer) */
+static int next_defer;                   /*   and the setting for the next mm_init */
+static int line_mode;                    /* small payloads stay within a cache line (mm_set_lines) */
+static int next_line_mode;               /*   and the setting for the next mm_init */
+static int track_touched;                /* operations note the blocks they change (mm_checkrecent) */
+static int check_errors;                 /* errors reported by the check in progress */
+static unsigned char *slab_map;          /* per heap page: slab class + 1, or 0 */
+static unsigned char *arena_map;         /* per heap page: id of the owning arena */
+static size_t page_maps_len;             /* bytes mapped for the two of them */
+
+static __thread arena_t *my_arena;       /* arena this thread allocates from */
+static __thread tcache_t tcache;
+static pthread_key_t tcache_key;         /* flushes tcache when a thread exits */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+//
+// Event counters for the fragmentation timeline (MM_EVENTS in config.h)
+// They are bumped under an arena lock but shared by all arenas, so they
+// are only exact while a single thread allocates.
+//
+#if MM_EVENTS
+static mm_events_t events;
+
+static inline ALWAYS_INLINE void EVENT(int ev, uint32_t arg) {
+  events.count[ev]++;
+  if (ev == MM_EV_EXTEND) {
+    events.extend_bytes += arg;
+  }
+  else if (ev == MM_EV_TRIM) {
+    events.trim_bytes += arg;
+  }
+  else if (ev == MM_EV_SEARCH) {
+    events.search_steps += arg;
+    if (arg > events.search_max) {
+      events.search_max = arg;
+    }
+  }
+}
+#else
+static inline ALWAYS_INLINE void EVENT(int ev, uint32_t arg) { }
+#endif
+
+//
+// Slab class, slot size and run for a request size or slot pointer
+//
+static inline ALWAYS_INLINE int SLAB_CLASS(uint32_t size) { return size_table[size].slab; }
+static inline ALWAYS_INLINE uint32_t SLAB_SLOT(int class) { return slab_slot[class]; }
+static inline ALWAYS_INLINE slab_t *SLAB_RUNP(void *p) {
+  return (slab_t *)((uintptr_t)p & ~(uintptr_t)(SLAB_RUN - 1));
+}
+static inline ALWAYS_INLINE char *SLAB_SLOTS(slab_t *run) {
+  // with line-aware placement the slots start on a line of their own
+  uintptr_t align = line_mode ? CACHE_LINE : ALIGNMENT;
+
+  return (char *)run + ((sizeof(slab_t) + align - 1) & ~(align - 1));
+}
+
+//
+// Index of the heap page holding p in slab_map and arena_map
+//
+static inline ALWAYS_INLINE size_t MAP_INDEX(void *p) {
+  return (uintptr_t)p / MAP_PAGE - (uintptr_t)heap_base / MAP_PAGE;
+}
+
+//
+// slab_class_of - Slab class of the slot at p, or -1 if p is a regular block
+//
+static inline ALWAYS_INLINE int slab_class_of(void *p) {
+  return (int)slab_map[MAP_INDEX(p)] - 1;
+}
+
+//
+// arena_of - Arena that owns the block or slot at p
+//
+static inline ALWAYS_INLINE arena_t *arena_of(void *p) {
+  return &arenas[arena_map[MAP_INDEX(p)]];
+}
+
+//
+// IS_HUGE - Is p a huge block with a mapping of its own?
+//
+static inline ALWAYS_INLINE int IS_HUGE(void *p) {
+  return (char *)p >= huge_lo && (char *)p <= huge_hi;
+}
+
+//
+// Read and write the 64-bit header of huge block bp: the length of its
+// mapping, with the allocated bit
+//
+static inline ALWAYS_INLINE size_t HUGE_LEN(void *bp) {
+  return *(size_t *)((char *)bp - DSIZE) & ~(size_t)0x7;
+}
+static inline ALWAYS_INLINE void SET_HUGE_LEN(void *bp, size_t len) {
+  *(size_t *)((char *)bp - DSIZE) = len | 1;
+}
+
+//
+// Start of the mapping of huge block bp; its header lies in the same page
+//
+static inline ALWAYS_INLINE char *HUGE_BASE(void *bp) {
+  return (char *)(((uintptr_t)bp - DSIZE) & ~(uintptr_t)(mem_pagesize() - 1));
+}
+
+//
+// adjust_size - Block size needed to hold a payload of size bytes
+//
+static inline ALWAYS_INLINE uint32_t adjust_size(uint32_t size) {
+  // small requests are one load from the table, which also rounds the
+  // smallest ones up to MIN_BLOCK, the size of a free block with both links and a footer
+  if (size <= TABLE_MAX) {
+      return size_table[size].asize;
+  }
+  // larger requests add in the header and round up to the nearest multiple of ALIGNMENT
+  return (size + OVERHEAD + ALIGNMENT - 1) & ~(uint32_t)(ALIGNMENT - 1);
+}
+
+//
+// CROSSES_LINE - Would a payload of size bytes at bp, which fits in a
+//                cache line, straddle two of them?
+//
+static inline ALWAYS_INLINE int CROSSES_LINE(void *bp, uint32_t size) {
+  return ((uintptr_t)bp & (CACHE_LINE - 1)) + size > CACHE_LINE;
+}
+
+//
+// usable_size - Payload bytes of the allocated block or slot at p
+// Called without the arena lock: while p is allocated, the lock holder
+// may only flip the prev-alloc bit of its header, never the size bits,
+// and both sides access the header atomically.
+//
+static inline ALWAYS_INLINE size_t usable_size(void *p) {
+  int class;
+
+  if (IS_HUGE(p)) {
+    return HUGE_LEN(p) - ((char *)p - HUGE_BASE(p));
+  }
+  class = slab_class_of(p);
+  return class >= 0 ? SLAB_SLOT(class) : GET_SIZE_ATOMIC(HDRP(p)) - OVERHEAD;
+}
 
 //
 // function prototypes for internal helper routines
 //
-static void *extend_heap(uint32_t words);
-static void place(void *bp, uint32_t asize);
-static void *find_fit(uint32_t asize);
-static void *coalesce(void *bp);
-static void printblock(void *bp); 
+static void *extend_heap(arena_t *a, uint32_t need);
+static void *heap_grow(arena_t *a, uint32_t size);
+static void *new_segment(arena_t *a, uint32_t size);
+static void mark_pages(arena_t *a, char *lo, char *hi);
+static arena_t *thread_arena(void);
+static void *arena_malloc(arena_t *a, uint32_t size);
+static void arena_free(arena_t *a, void *bp);
+static void *arena_realloc(arena_t *a, void *ptr, uint32_t size);
+static void *huge_malloc(size_t size, size_t align);
+static void *huge_realloc(void *ptr, size_t size);
+static void remote_free(arena_t *a, void *bp);
+static void drain_remote(arena_t *a);
+static void *tcache_get(uint32_t size);
+static int tcache_put(void *bp);
+static void tcache_flush(void *unused);
+static void tcache_key_init(void);
+static void *alloc_block(arena_t *a, uint32_t asize);
+static void *alloc_aligned(arena_t *a, uint32_t asize, uint32_t align);
+static void *alloc_line(arena_t *a, uint32_t asize, uint32_t size);
+static void free_block(arena_t *a, void *bp);
+static int trim_heap(arena_t *a, void *bp);
+static void release_pages(void *bp, char *lo, char *hi);
+static void release_later(arena_t *a, void *bp, char *lo, char *hi);
+static void release_due(arena_t *a);
+static void release_slot(arena_t *a, release_t *r);
+static release_t *pending_of(arena_t *a, void *bp);
+static void place(arena_t *a, void *bp, uint32_t asize);
+static void *find_fit(arena_t *a, uint32_t asize);
+static void *seg_fit(arena_t *a, uint32_t asize, uint32_t *probes);
+static void *first_fit(arena_t *a, uint32_t asize, uint32_t *probes);
+static void *next_fit(arena_t *a, uint32_t asize, uint32_t *probes);
+static void *best_fit(arena_t *a, uint32_t asize, uint32_t *probes, uint32_t cutoff);
+static void count_probes(arena_t *a, uint32_t probes);
+static void *coalesce(arena_t *a, void *bp);
+static void quick_push(arena_t *a, void *bp);
+static void quick_flush(arena_t *a);
+static int size_bin(uint32_t size);
+static int next_bin(arena_t *a, int bin);
+static void insert_free(arena_t *a, void *bp);
+static void remove_free(arena_t *a, void *bp);
+static void shrink_block(arena_t *a, void *bp, uint32_t asize);
+static void split_block(arena_t *a, void *bp, uint32_t asize);
+static int slab_wanted(arena_t *a, uint32_t size);
+static void track_small(arena_t *a, uint32_t bsize, int delta);
+static void *slab_alloc(arena_t *a, int class);
+static void slab_free(arena_t *a, void *p, int class);
+static slab_t *slab_new_run(arena_t *a, int class);
+static void slab_push(arena_t *a, slab_t *run);
+static void slab_unlink(arena_t *a, slab_t *run);
+static void report(const char *fmt, ...);
+static long check_lists(arena_t *a, long limit);
+static void check_free(arena_t *a, char *bp);
+static void check_near(arena_t *a, char *bp);
+static void check_run(slab_t *run);
+static void printblock(void *bp);
 static void checkblock(void *bp);
 
 
 
 //
-// mm_init - Initialize the memory manager 
+// mm_init - Initialize the memory manager
 // creates a heap with an initial free block
 
-int mm_init(void) 
+int mm_init(void)
 {
-  //
-  // You need to provide this
-  //
+  arena_t *a;
+  int i;
+
   // mm_init function initializes the allocator, returning 0 if successful and −1 otherwise
-  if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1) {
-      return -1; 
+  if ((heap_listp = mem_sbrk(2*ALIGNMENT)) == (void *)-1) {
+      return -1;
+  }
+  heap_base = heap_listp;
+  huge_lo = mem_map_lo();
+  huge_hi = mem_map_hi();
+
+  // every arena starts out empty; mm_init runs before any other thread
+  // uses the allocator, so nothing needs a lock yet
+  for (i = 0; i < NUM_ARENAS; i++) {
+      a = &arenas[i];
+      if (!arenas_ready) {
+          pthread_mutex_init(&a->lock, NULL);
+      }
+      a->id = i;
+      memset(a->free_lists, 0, sizeof(a->free_lists));
+      memset(a->bin_bitmap, 0, sizeof(a->bin_bitmap));
+      memset(a->slab_partial, 0, sizeof(a->slab_partial));
+      memset(a->slab_on, 0, sizeof(a->slab_on));
+      memset(a->small_live, 0, sizeof(a->small_live));
+      memset(&a->fit, 0, sizeof(a->fit));
+      memset(a->quick, 0, sizeof(a->quick));
+      a->quick_count = 0;
+      memset(a->pending, 0, sizeof(a->pending));
+      a->npending = 0;
+      a->frees = 0;
+      a->ntouched = TOUCH_MAX + 1;      // nothing checked yet
+      a->rover = NULL;
+      a->remote = NULL;
+  }
+  arenas_ready = 1;
+
+  // slab_map and arena_map cover the largest heap memlib allows. They
+  // are mapped afresh every time: new pages read as zero, and only those
+  // for the part of the heap in use ever get touched.
+  if (page_maps_len != 0) {
+      munmap(slab_map, page_maps_len);
   }
-  
-  // initialize last fit block to be start of the heap list, start at first block on heap
-  last_fitbp = heap_listp;
+  page_maps_len = 2 * (mem_heap_limit() / MAP_PAGE + 2);
+  slab_map = mmap(NULL, page_maps_len, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (slab_map == MAP_FAILED) {
+      page_maps_len = 0;
+      return -1;
+  }
+  arena_map = slab_map + page_maps_len / 2;
+  tail_arena = &arenas[0];
+  heap_epoch++;
+  fit_policy = next_policy;
+  defer_coalesce = next_defer;
+  line_mode = next_line_mode;
+#if MM_EVENTS
+  memset(&events, 0, sizeof(events));
+#endif
 
   // Page 883, Figure 9.44 - mm_init function gets four words from the memory system
+  // (2*ALIGNMENT bytes, which is four words at the default 8 byte alignment)
   // initializes them to create the empty free list
-  // prologue block, which is an 8-byte allocated block consisting of only a header and a footer
+  // prologue block, which is an ALIGNMENT-byte allocated block consisting of only a header and a footer
   // The prologue block is created during initialization and is never freed.
-  PUT(heap_listp, 0); /* Alignment padding */
-  PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1)); /* Prologue header */ 
-  PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */ 
-  PUT(heap_listp + (3*WSIZE), PACK(0, 1)); /* Epilogue header */ 
-  heap_listp += (2*WSIZE); /* Extend the empty heap with a free block of CHUNKSIZE bytes */ 
-    
-        
+  memset(heap_listp, 0, ALIGNMENT - WSIZE); /* Alignment padding */
+  heap_listp += ALIGNMENT;
+  PUT(HDRP(heap_listp), PACK(ALIGNMENT, 1, 1)); /* Prologue header */
+  PUT(FTRP(heap_listp), PACK(ALIGNMENT, 1, 1)); /* Prologue footer */
+  PUT(HDRP(NEXT_BLKP(heap_listp)), PACK(0, 1, 1)); /* Epilogue header */
+  /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+
+
   // calls the extend_heap function (Figure 9.45)
   // extends the heap by CHUNKSIZE bytes and creates the initial free block.
-  if (extend_heap(CHUNKSIZE/WSIZE) == NULL) {
+  if (extend_heap(&arenas[0], CHUNKSIZE) == NULL) {
       return -1;
   }
   return 0;
@@ -172,341 +694,2007 @@ int mm_init(void)
 
 
 //
-// extend_heap - Extend heap with free block and return its block pointer
-/* invoked in two different circumstances: 
+// extend_heap - Give arena a a free block of at least need bytes and
+//               return its block pointer; a's lock must be held
+/* invoked in two different circumstances:
  * (1) when the heap is initialized
  * (2) when mm_malloc is unable to find a suitable fit
 */
+static void *extend_heap(arena_t *a, uint32_t need)
+{
+  char *epilogue;
+  int tail;
+  void *bp;
+
+  pthread_mutex_lock(&heap_lock);
+  if (tail_arena == a) {
+      // a free block at the end of the heap merges with the new space, so
+      // we only have to ask for what it is missing
+      epilogue = (char *)mem_heap_hi() + 1 - WSIZE;
+      tail = GET_PREV_ALLOC(epilogue) ? 0 : GET_SIZE(epilogue - WSIZE);
+      bp = heap_grow(a, MAX((int)need - tail, tail ? MIN_BLOCK : CHUNKSIZE));
+      // unless the merged block would be too big for its header
+      if (bp != NULL && GET_SIZE(HDRP(bp)) < need) {
+          bp = heap_grow(a, need);
+      }
+  }
+  else {
+      // another arena owns the top of the heap, start a segment of our own
+      bp = new_segment(a, MAX(need, ARENA_CHUNK));
+  }
+  pthread_mutex_unlock(&heap_lock);
+  return bp;
+}
 
-static void *extend_heap(uint32_t words) 
+//
+// heap_grow - Extend the tail segment of arena a by size bytes and
+//             return the (coalesced) free block; heap_lock must be held
+//
+static void *heap_grow(arena_t *a, uint32_t size)
 {
   //
   // Page 883 in book, Figure 9.45
   //
   char *bp;
-  size_t size;
   /* Allocate an even number of words to maintain alignment */
-  // extend_heap rounds up the requested size to the nearest multiple of 2 words (8 bytes)
+  // rounds up the requested size to the nearest multiple of ALIGNMENT
   // then requests the additional heap space from the memory system
-  size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
+  size = ALIGNMENT * ((size + (ALIGNMENT-1)) / ALIGNMENT);
+  // the free list links cannot reach past HEAP_SPAN
+  if ((char *)mem_heap_hi() + 1 + size - heap_base > HEAP_SPAN) {
+      return NULL;
+  }
   // mem_srbk returns the start address of the new area
   if ((long)(bp = mem_sbrk(size)) == -1) {
       return NULL;
   }
+  mark_pages(a, bp, bp + size);
+  EVENT(MM_EV_EXTEND, size);
 
   /* Initialize free block header/footer and the epilogue header */
-  PUT(HDRP(bp), PACK(size, 0)); /* Free block header */
-  PUT(FTRP(bp), PACK(size, 0)); /* Free block footer */
-  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
-    
+  // the old epilogue header becomes the new block's header, and it
+  // already knows whether the block before it is allocated
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)), 0)); /* Free block header */
+  PUT(FTRP(bp), PACK(size, 0, 0)); /* Free block footer */
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 0, 1)); /* New epilogue header */
+
   /* Coalesce if the previous block was free */
   // case that the previous heap was terminated by a free block
-  // we call the coalesce function to merge the two free blocks and return the block pointer of the merged blocks 
-  return coalesce(bp);
+  // we call the coalesce function to merge the two free blocks and return the block pointer of the merged blocks
+  // coalesce also links the resulting block into its free list
+  return coalesce(a, bp);
 }
 
-
-
 //
-// Practice problem 9.8
+// new_segment - Start a segment for arena a on the next page boundary
+//               holding one free block of size bytes; heap_lock must be held
 //
-// find_fit - Find a fit for a block with asize bytes 
+// The segment is laid out like the start of the heap, with an alignment
+// pad in place of the prologue (nothing in front of it can be free) and
+// an epilogue of its own. The bytes up to the page boundary are wasted,
+// but they keep every page owned by a single arena.
 //
-static void *find_fit(uint32_t asize)
+static void *new_segment(arena_t *a, uint32_t size)
 {
-  // Next-fit search
-  // initialize a block pointer starting at the last fit block of the heap -> last_fitbp
-  void *bp = last_fitbp;
+  char *brk = (char *)mem_heap_hi() + 1;
+  char *start = (char *)(((uintptr_t)brk + MAP_PAGE - 1) & ~(uintptr_t)(MAP_PAGE - 1));
+  char *bp = start + ALIGNMENT;
 
-  // iterate over each block after last found fit in the heap until size is less than 0
-  // incr to the next block in the heap each time
-  for (last_fitbp = bp; GET_SIZE(HDRP(last_fitbp)) > 0; last_fitbp = NEXT_BLKP(last_fitbp)){
-      // check to see if curr block is allocated and if it's size if big enough for the desired asize block requested
-      if(!GET_ALLOC(HDRP(last_fitbp)) && (asize <= GET_SIZE(HDRP(last_fitbp)))){
-          // fit was found for desired block of size asize
-          // update last_fitbp to the curr bp that was found as a fit within coalesce
-          return last_fitbp;
-      }
+  size = ALIGNMENT * ((size + (ALIGNMENT-1)) / ALIGNMENT);
+  if (bp + size - heap_base > HEAP_SPAN ||
+      (long)mem_sbrk((start - brk) + ALIGNMENT + size) == -1) {
+      return NULL;
   }
+  mark_pages(a, start, bp + size);
+  EVENT(MM_EV_EXTEND, (start - brk) + ALIGNMENT + size);
 
-  // First-fit search up till last_fitbp
-  // initialize a block pointer starting at the beginiing of the heap -> heap_listp
-  // iterate over each block in the heap until you reach back around at last fit found
-  // until size of heap is less than 0
-  // incr to the next block in the heap each time
-  for (last_fitbp = heap_listp; last_fitbp < (char *)bp; last_fitbp = NEXT_BLKP(last_fitbp)){
-      // check to see if curr block is allocated and if it's size if big enough for the desired asize block requested
-      if(!GET_ALLOC(HDRP(last_fitbp)) && (asize <= GET_SIZE(HDRP(last_fitbp)))){
-          // fit was found for desired block of size asize
-          // update last_fitbp to the curr bp that was found as a fit within coalesce
-          return last_fitbp;
-      }
-  }
-     
-  return NULL; /* no fit */
+  PUT(HDRP(bp), PACK(size, 1, 0)); /* Free block header */
+  PUT(FTRP(bp), PACK(size, 0, 0)); /* Free block footer */
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 0, 1)); /* Segment epilogue header */
+  tail_arena = a;
+  return coalesce(a, bp);
 }
 
-
-
-// 
-// mm_free - Free a block 
-// An application frees a previously allocated block by calling the mm_free function
-// Frees the requested block (bp) and then merges adjacent free blocks using the boundary-tags coalescing technique
-void mm_free(void *bp)
+//
+// mark_pages - Record arena a as the owner of the heap pages in [lo, hi)
+//
+static void mark_pages(arena_t *a, char *lo, char *hi)
 {
-  //
-  // You need to provide this
-  // For example, given a pointer bp to the current block
-  // we could use the following line of code to determine the size of the next block in memory:
-  // size_t size = GET_SIZE(HDRP(NEXT_BLKP(bp)));
-  // frees the requested block (bp)
-  // then merges adjacent free blocks using the boundary-tags coalescing technique
-  size_t size = GET_SIZE(HDRP(bp));
-  
-  PUT(HDRP(bp), PACK(size, 0));
-  PUT(FTRP(bp), PACK(size, 0));
-  coalesce(bp);
+  memset(&arena_map[MAP_INDEX(lo)], a->id, MAP_INDEX(hi - 1) - MAP_INDEX(lo) + 1);
 }
 
-
-
+/////////////////////////////////////////////////////////////////////////////
+//
+// Threads, arenas and the per-thread cache
+//
+/////////////////////////////////////////////////////////////////////////////
 
 //
-// coalesce - boundary tag coalescing. Return ptr to coalesced block
+// thread_arena - Arena of the calling thread, binding it on first use
 //
-static void *coalesce(void *bp) 
+static arena_t *thread_arena(void)
 {
-  // Page 885, Figure 9.46
-  // get size of previous block from footer 
-  // get size of next block from header
-  // get size of current block from header
-  size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-  size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-  size_t size = GET_SIZE(HDRP(bp));
-
-  // Case 1: prev and next blocks are both allocated
-  // Simply return the current blocks pointer
-  if (prev_alloc && next_alloc) {
-      return bp;
-  }
-    
-  // Case 2: prev block is allocated and next block is free
-  // Merge current block and next block
-  // Update header of current block and footer of next block
-  // New size = combined sizes of the curr and next blocks
-  else if (prev_alloc && !next_alloc) {
-      // get next blocks header and incr size
-      // update header & footer of newly combined block to be unallocated -> 0
-      size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-      PUT(HDRP(bp), PACK(size, 0));
-      PUT(FTRP(bp), PACK(size,0));
-  }
-    
-  // Case 3: prev block is free and next block is allocated
-  // Merge previous and current blocks
-  // Update header of previous block and footer of current block
-  // New size = combined sizes of the previous and curr blocks
-  else if (!prev_alloc && next_alloc) {
-      // get previous blocks header and incr size
-      // update header & footer of newly combined block to be unallocated -> 0
-      // update pointer so it is now at previous block to account for 1 newly combined unallocated block
-      size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-      PUT(FTRP(bp), PACK(size, 0));
-      PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-      bp = PREV_BLKP(bp);
-  }
-    
-  // Case 4: prev block is free and next block is free
-  // Merge previous, curr and next blocks
-  // Update header of prev block and footer of next block
-  // New size = combined sizes of the prev, curr, and next blocks
-  else {
-      // get previous blocks header & next blocks footer, and incr size to perform merge
-      // update header & footer of newly combined block to be unallocated -> 0
-      // update pointer so it is now at previous block to account for 1 newly combined unallocated block
-      size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-      PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-      PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
-      bp = PREV_BLKP(bp);
-  }
-
-  // Need to confirm that we do not have our last_fitbp within our coalesced block
-  if ((last_fitbp >= (char *)bp) && (last_fitbp < (char *)NEXT_BLKP(bp))){
-  	// Update last_fitbp to be the beginning of our current coalesced 
-    last_fitbp = bp;
+  if (my_arena == NULL) {
+      my_arena = &arenas[__atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % NUM_ARENAS];
+      // the key's destructor only runs for threads with a non-NULL value
+      pthread_once(&tcache_once, tcache_key_init);
+      pthread_setspecific(tcache_key, &tcache);
   }
-      
-  // return pointer to current block
-  return bp;
+  return my_arena;
 }
 
-
+static void tcache_key_init(void)
+{
+  pthread_key_create(&tcache_key, tcache_flush);
+}
 
 //
-// mm_malloc - Allocate a block with at least size bytes of payload 
-// An application requests a block of size bytes of memory by calling the mm_malloc function
-void *mm_malloc(uint32_t size) 
+// tcache_get - Pop a cached block with room for size bytes, or NULL
+//
+static void *tcache_get(uint32_t size)
 {
-  //
-  // You need to provide this
-  //
-  size_t asize; // Adjusted block size
-  size_t extendsize; // Amount to extend heap if no fit
-  char *bp; // block pointer
-  // Ignore size extension if trival 
-  if (size == 0) {
-      return NULL;
-  }
-    
-  /* Adjust block size to include overhead and alignment reqs. */ 
-  // minimum block size of 16 bytes: 8 bytes to satisfy the alignment requirement and 8 more bytes for the overhead of the header and footer
-  if (size <= DSIZE) {
-      asize = 2*DSIZE; 
-  }
-  
-  // requests over 8 bytes, the general rule is to add in the overhead bytes and then round up to the nearest multiple of 8
-  else {
-      asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
-  }
-    
-  /* Search the free list for a fit */ 
-  // If there is a fit, then the allocator places the requested block and optionally splits the excess
-  // return block pointer to newly allocated block
-  if ((bp = find_fit(asize)) != NULL) {
-      place(bp, asize);
-      return bp; 
-  }
-    
-  /* No fit found. Get more memory and place the block */ 
-  // extends the heap with a new free block, places the requested block in the new free block
-  extendsize = MAX(asize, CHUNKSIZE);
-  if ((bp = extend_heap(extendsize/WSIZE)) == NULL) {
+  int class = SLAB_CLASS(size);
+  void *bp = tcache.head[class];
+
+  if (bp == NULL || tcache.epoch != heap_epoch) {
       return NULL;
   }
-  place(bp, asize);
+  tcache.head[class] = *(void **)bp;
+  tcache.count[class]--;
   return bp;
 }
-    
- 
 
 //
+// tcache_put - Keep block bp, which belongs to this thread's arena, in
+//              the cache if it is small and there is room; 1 if kept
 //
-// Practice problem 9.9
-//
-// place - Place block of asize bytes at start of free block bp 
-//         and split if remainder would be at least minimum block size
+// A block goes on the stack of the largest class its usable bytes hold,
+// so every block on stack c serves any request that would land in slab
+// class c. With line-aware placement only the bytes up to the end of
+// its cache line count, but only of a block small enough to be cached
+// at all: a big one must not become a small class's slot.
 //
-static void place(void *bp, uint32_t asize)
+static int tcache_put(void *bp)
 {
-  // initialize size of bp
-  size_t csize = GET_SIZE(HDRP(bp));
-    
-  // first check to see if the size of asize if equal to that of the block size
-  // if it's equal simply update the bp to the new size, and update the block to allocated
-  if ((csize - asize) >= (2 * DSIZE)) {
-      PUT(HDRP(bp), PACK(asize, 1));
-      PUT(FTRP(bp), PACK(asize, 1));
-      bp = NEXT_BLKP(bp);
-      PUT(HDRP(bp), PACK(csize - asize, 0));
-      PUT(FTRP(bp), PACK(csize - asize, 0));
-  }
-  
-  // if asize < bp size, then update the curr bp size and update to allocated
-  // then move to the next bp and update it's allocation to free, and it's new size
-  else {
-      PUT(HDRP(bp), PACK(csize, 1));
-      PUT(FTRP(bp), PACK(csize, 1));
-  }  
-}
+  size_t usable = usable_size(bp);
+  int class;
 
+  class = usable <= TABLE_MAX ? size_table[usable].fits : NO_CLASS;
+  if (line_mode && class != NO_CLASS) {
+      usable = MIN(usable, CACHE_LINE - ((uintptr_t)bp & (CACHE_LINE - 1)));
+      class = size_table[usable].fits;
+  }
 
+  if (tcache.epoch != heap_epoch) {
+      // the heap these entries pointed into is gone
+      memset(&tcache, 0, sizeof(tcache));
+      tcache.epoch = heap_epoch;
+  }
+  if (class == NO_CLASS || tcache.count[class] == TCACHE_MAX) {
+      return 0;
+  }
+  *(void **)bp = tcache.head[class];
+  tcache.head[class] = bp;
+  tcache.count[class]++;
+  return 1;
+}
 
 //
-// mm_realloc -- implemented for you
+// tcache_flush - Hand every cached block back to the arena when the
+//                thread exits
 //
-void *mm_realloc(void *ptr, uint32_t size)
+static void tcache_flush(void *unused)
 {
-  void *newp;
-  uint32_t copySize;
+  arena_t *a = my_arena;
+  void *bp;
+  int i;
 
-  newp = mm_malloc(size);
-  if (newp == NULL) {
-    printf("ERROR: mm_malloc failed in mm_realloc\n");
-    exit(1);
+  if (tcache.epoch != heap_epoch) {
+      return;
   }
-  copySize = GET_SIZE(HDRP(ptr));
-  if (size < copySize) {
-    copySize = size;
+  pthread_mutex_lock(&a->lock);
+  for (i = 0; i < SLAB_CLASSES; i++) {
+      while ((bp = tcache.head[i]) != NULL) {
+          tcache.head[i] = *(void **)bp;
+          arena_free(a, bp);
+      }
+      tcache.count[i] = 0;
   }
-  memcpy(newp, ptr, copySize);
-  mm_free(ptr);
-  return newp;
+  pthread_mutex_unlock(&a->lock);
 }
 
 //
-// mm_checkheap - Check the heap for consistency 
+// remote_free - Queue block bp for the arena a that owns it
+// Any number of threads may push at once (a Treiber stack); only the
+// owner, holding its lock, takes the whole stack off in drain_remote.
 //
-void mm_checkheap(int verbose) 
+static void remote_free(arena_t *a, void *bp)
+{
+  void *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+
+  do {
+      *(void **)bp = head;
+  } while (!__atomic_compare_exchange_n(&a->remote, &head, bp, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+//
+// drain_remote - Free every block other threads queued for arena a;
+//                a's lock must be held
+//
+static void drain_remote(arena_t *a)
+{
+  void *bp, *next;
+
+  if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) == NULL) {
+      return;
+  }
+  for (bp = __atomic_exchange_n(&a->remote, NULL, __ATOMIC_ACQUIRE); bp != NULL; bp = next) {
+      next = *(void **)bp;
+      arena_free(a, bp);
+  }
+}
+
+
+
+//
+// size_bin - Map a block size onto the index of its segregated list
+// Small sizes get bin floor(log2(size)) - 4. A large size is split into
+// its power of two fl and the next SL_BITS bits below the leading one.
+//
+static int size_bin(uint32_t size)
+{
+  int fl = 31 - __builtin_clz(size);
+  int sl;
+
+  if (size < LARGE_MIN) {
+      return fl - 4;
+  }
+  sl = (size >> (fl - SL_BITS)) & ((1 << SL_BITS) - 1);
+  return SMALL_BINS + ((fl - LARGE_SHIFT) << SL_BITS) + sl;
+}
+
+//
+// next_bin - First non-empty bin above bin, or -1 if there is none
+// Two levels: skip whole zero words of the bitmap, then ctz inside one.
+//
+static int next_bin(arena_t *a, int bin)
+{
+  int w = ++bin / 64;
+  uint64_t bits;
+
+  if (bin >= NUM_BINS) {
+      return -1;
+  }
+  bits = a->bin_bitmap[w] & (~(uint64_t)0 << (bin % 64));
+  while (bits == 0) {
+      if (++w == BIN_WORDS) {
+          return -1;
+      }
+      bits = a->bin_bitmap[w];
+  }
+  return w * 64 + __builtin_ctzll(bits);
+}
+
+//
+// touch - Note that bp changed, for mm_checkrecent
+//
+static inline ALWAYS_INLINE void touch(arena_t *a, void *bp)
+{
+  if (!track_touched || a->ntouched > TOUCH_MAX) {
+      return;
+  }
+  if (a->ntouched < TOUCH_MAX) {
+      a->touched[a->ntouched] = bp;
+  }
+  a->ntouched++;
+}
+
+//
+// absorb - Note that block gone was merged into block bp; a pointer to
+//          it would now point into the middle of bp
+//
+static inline ALWAYS_INLINE void absorb(arena_t *a, void *gone, void *bp)
+{
+  int i;
+
+  if (!track_touched) {
+      return;
+  }
+  for (i = 0; i < a->ntouched && i < TOUCH_MAX; i++) {
+      if (a->touched[i] == gone) {
+          a->touched[i] = bp;
+      }
+  }
+}
+
+//
+// insert_free - Push free block bp onto the front of its bin (LIFO)
+//
+static void insert_free(arena_t *a, void *bp)
+{
+  int bin = size_bin(GET_SIZE(HDRP(bp)));
+  char *head = a->free_lists[bin];
+
+  touch(a, bp);
+
+  SET_PRED(bp, NULL);
+  SET_SUCC(bp, head);
+  if (head != NULL) {
+      SET_PRED(head, bp);
+  }
+  a->free_lists[bin] = bp;
+  a->bin_bitmap[bin / 64] |= (uint64_t)1 << (bin % 64);
+}
+
+//
+// remove_free - Unlink free block bp from its bin in O(1)
+//
+static void remove_free(arena_t *a, void *bp)
+{
+  char *pred = PRED(bp);
+  char *succ = SUCC(bp);
+  release_t *r;
+  int bin;
+
+  // next fit carries on from the block after the one it handed out
+  if (a->rover == bp) {
+      a->rover = succ;
+  }
+  // a block that is used or merged again is no longer waiting to be released
+  if (a->npending > 0 && GET_SIZE(HDRP(bp)) >= RELEASE_MIN &&
+      (r = pending_of(a, bp)) != NULL) {
+      r->bp = NULL;
+      a->npending--;
+  }
+
+  if (pred != NULL) {
+      SET_SUCC(pred, succ);
+  }
+  else {
+      bin = size_bin(GET_SIZE(HDRP(bp)));
+      a->free_lists[bin] = succ;
+      if (succ == NULL) {
+          a->bin_bitmap[bin / 64] &= ~((uint64_t)1 << (bin % 64));
+      }
+  }
+  if (succ != NULL) {
+      SET_PRED(succ, pred);
+  }
+}
+
+
+
+//
+// Practice problem 9.8
+//
+// find_fit - Find a fit for a block with asize bytes using the current
+//            placement policy, and count the free blocks it examined
+//
+static void *find_fit(arena_t *a, uint32_t asize)
+{
+  uint32_t probes = 0;
+  char *bp;
+
+  switch (fit_policy) {
+  case MM_FIT_FIRST:
+      bp = first_fit(a, asize, &probes);
+      break;
+  case MM_FIT_NEXT:
+      bp = next_fit(a, asize, &probes);
+      break;
+  case MM_FIT_BEST:
+      bp = best_fit(a, asize, &probes, 0);
+      break;
+  case MM_FIT_GOOD:
+      bp = best_fit(a, asize, &probes, asize >> GOOD_SHIFT);
+      break;
+  default:
+      bp = seg_fit(a, asize, &probes);
+      break;
+  }
+  count_probes(a, probes);
+  EVENT(MM_EV_SEARCH, probes);
+  return bp;
+}
+
+//
+// seg_fit - Segregated fit, the default policy
+//
+static void *seg_fit(arena_t *a, uint32_t asize, uint32_t *probes)
+{
+  int bin = size_bin(asize);
+  char *bp;
+  char *best = NULL;
+
+  // The blocks in asize's own bin may still be too small, so that list
+  // has to be searched. Small bins are taken first-fit. In a large bin,
+  // where one wasted fraction costs real bytes, keep the tightest of the
+  // first FIT_PROBES blocks, stopping early on an exact fit.
+  for (bp = a->free_lists[bin]; bp != NULL; bp = SUCC(bp)) {
+      ++*probes;
+      if (asize <= GET_SIZE(HDRP(bp)) &&
+          (best == NULL || GET_SIZE(HDRP(bp)) < GET_SIZE(HDRP(best)))) {
+          best = bp;
+          if (asize < LARGE_MIN || asize == GET_SIZE(HDRP(bp))) {
+              break;
+          }
+      }
+      if (asize >= LARGE_MIN && *probes == FIT_PROBES) {
+          break;
+      }
+  }
+  if (best != NULL) {
+      return best;
+  }
+
+  // Every block in a larger bin is big enough, and the nearest one
+  // wastes the least. The bitmap finds it without touching empty lists.
+  if ((bin = next_bin(a, bin)) >= 0) {
+      ++*probes;
+      return a->free_lists[bin];
+  }
+
+  return NULL; /* no fit */
+}
+
+//
+// first_fit - First block that fits, walking asize's bin and then every
+//             larger one in order
+//
+static void *first_fit(arena_t *a, uint32_t asize, uint32_t *probes)
+{
+  int bin;
+  char *bp;
+
+  for (bin = size_bin(asize); bin >= 0; bin = next_bin(a, bin)) {
+      for (bp = a->free_lists[bin]; bp != NULL; bp = SUCC(bp)) {
+          ++*probes;
+          if (asize <= GET_SIZE(HDRP(bp))) {
+              return bp;
+          }
+      }
+  }
+  return NULL; /* no fit */
+}
+
+//
+// next_fit - First fit that starts at the rover instead of the front,
+//            wrapping around to asize's bin once it runs off the end
+//
+static void *next_fit(arena_t *a, uint32_t asize, uint32_t *probes)
+{
+  int start = size_bin(asize);
+  int bin = start;
+  char *bp = a->free_lists[start];
+  char *from = NULL;
+
+  // the rover only helps if it sits in a bin that can hold the request
+  if (a->rover != NULL && size_bin(GET_SIZE(HDRP(a->rover))) >= start) {
+      from = bp = a->rover;
+      bin = size_bin(GET_SIZE(HDRP(bp)));
+  }
+
+  for (;;) {
+      for (; bp != NULL; bp = SUCC(bp)) {
+          ++*probes;
+          if (asize <= GET_SIZE(HDRP(bp))) {
+              return a->rover = bp;
+          }
+      }
+      if ((bin = next_bin(a, bin)) < 0) {
+          break;
+      }
+      bp = a->free_lists[bin];
+  }
+
+  // wrap around, up to where this search started
+  if (from != NULL) {
+      for (bin = start; bin >= 0; bin = next_bin(a, bin)) {
+          for (bp = a->free_lists[bin]; bp != NULL; bp = SUCC(bp)) {
+              if (bp == from) {
+                  return NULL;
+              }
+              ++*probes;
+              if (asize <= GET_SIZE(HDRP(bp))) {
+                  return a->rover = bp;
+              }
+          }
+      }
+  }
+  return NULL; /* no fit */
+}
+
+//
+// best_fit - Smallest block that fits, or with a cutoff the first block
+//            that wastes no more than cutoff bytes (good fit)
+// Every block in a bin is bigger than every block in the bins below it,
+// so the first bin holding any fit holds the best one.
+//
+static void *best_fit(arena_t *a, uint32_t asize, uint32_t *probes, uint32_t cutoff)
+{
+  int bin;
+  char *bp;
+  char *best = NULL;
+  uint32_t size;
+
+  for (bin = size_bin(asize); bin >= 0; bin = next_bin(a, bin)) {
+      for (bp = a->free_lists[bin]; bp != NULL; bp = SUCC(bp)) {
+          ++*probes;
+          size = GET_SIZE(HDRP(bp));
+          if (asize <= size && (best == NULL || size < GET_SIZE(HDRP(best)))) {
+              best = bp;
+              if (size - asize <= cutoff) {
+                  return best;
+              }
+          }
+      }
+      if (best != NULL) {
+          return best;
+      }
+  }
+  return NULL; /* no fit */
+}
+
+//
+// count_probes - Add one search of the given length to a's fit statistics
+//
+static void count_probes(arena_t *a, uint32_t probes)
+{
+  int b = probes ? 32 - __builtin_clz(probes) : 0;
+
+  a->fit.searches++;
+  a->fit.probes += probes;
+  if (probes > a->fit.max) {
+      a->fit.max = probes;
+  }
+  a->fit.hist[b < MM_PROBE_BUCKETS ? b : MM_PROBE_BUCKETS - 1]++;
+}
+
+
+
+//
+// mm_free - Free a block
+// An application frees a previously allocated block by calling the mm_free function
+// Frees the requested block (bp) and then merges adjacent free blocks using the boundary-tags coalescing technique
+void mm_free(void *bp)
+{
+  arena_t *a;
+
+  if (bp == NULL) {
+      return;
+  }
+
+  // a huge block goes straight back to the OS
+  if (IS_HUGE(bp)) {
+      mem_unmap(HUGE_BASE(bp), HUGE_LEN(bp));
+      return;
+  }
+
+  // a small block of our own arena is parked in the thread cache, one
+  // from another arena goes back to its owner without taking its lock
+  a = arena_of(bp);
+  if (a != thread_arena()) {
+      remote_free(a, bp);
+      return;
+  }
+  if (tcache_put(bp)) {
+      return;
+  }
+
+  pthread_mutex_lock(&a->lock);
+  drain_remote(a);
+  arena_free(a, bp);
+  pthread_mutex_unlock(&a->lock);
+}
+
+//
+// arena_free - Free block or slot bp of arena a; a's lock must be held
+//
+static void arena_free(arena_t *a, void *bp)
+{
+  int class;
+
+  // slab slots go back to their run's bitmap
+  if ((class = slab_class_of(bp)) >= 0) {
+      slab_free(a, bp, class);
+      return;
+  }
+
+  track_small(a, GET_SIZE(HDRP(bp)), -1);
+
+  // with deferred coalescing a small block only joins a quick list
+  if (defer_coalesce && GET_SIZE(HDRP(bp)) <= QUICK_MAX) {
+      quick_push(a, bp);
+      return;
+  }
+  free_block(a, bp);
+}
+
+//
+// quick_push - Put allocated block bp on the quick list for its size,
+//              coalescing every quick list once they are over budget
+//
+static void quick_push(arena_t *a, void *bp)
+{
+  int class = GET_SIZE(HDRP(bp)) / ALIGNMENT;
+
+  *(char **)bp = a->quick[class];
+  a->quick[class] = bp;
+  if (++a->quick_count > QUICK_BUDGET) {
+      quick_flush(a);
+  }
+}
+
+//
+// quick_flush - Free and coalesce every block on a's quick lists
+//
+static void quick_flush(arena_t *a)
+{
+  char *bp;
+  int i;
+
+  for (i = 0; i < QUICK_CLASSES; i++) {
+      while ((bp = a->quick[i]) != NULL) {
+          a->quick[i] = *(char **)bp;
+          free_block(a, bp);
+      }
+  }
+  a->quick_count = 0;
+}
+
+//
+// free_block - Mark block bp free and merge it with its free neighbors
+//
+static void free_block(arena_t *a, void *bp)
+{
+  // frees the requested block (bp)
+  // then merges adjacent free blocks using the boundary-tags coalescing technique
+  size_t size = GET_SIZE(HDRP(bp));
+  char *lo = bp, *hi = (char *)bp + size;
+  char *prev, *next = NEXT_BLKP(bp);
+  release_t *r;
+  int trimmed = 0;
+
+  // pages of a free neighbor of RELEASE_MIN bytes or more have been
+  // released, unless it is still waiting for its turn, so only the rest
+  // of the merge is new to them
+  if (!GET_PREV_ALLOC(HDRP(bp))) {
+      prev = (char *)bp - GET_SIZE((char *)bp - DSIZE);
+      if (GET_SIZE(HDRP(prev)) < RELEASE_MIN) {
+          lo = prev;
+      }
+      else if ((r = pending_of(a, prev)) != NULL) {
+          lo = r->lo;
+      }
+  }
+  if (!GET_ALLOC(HDRP(next))) {
+      if (GET_SIZE(HDRP(next)) < RELEASE_MIN) {
+          hi += GET_SIZE(HDRP(next));
+      }
+      else if ((r = pending_of(a, next)) != NULL) {
+          hi = r->hi;
+      }
+  }
+
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)), 0));
+  PUT(FTRP(bp), PACK(size, 0, 0));
+  bp = coalesce(a, bp);
+
+  // only big blocks are worth a system call; the end of the heap goes
+  // at once, since the brk counts whether in use or not, while pages
+  // inside the heap wait until the block has stayed free for a while
+  a->frees++;
+  size = GET_SIZE(HDRP(bp));
+  if (size > TRIM_THRESHOLD && GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0) {
+      trimmed = trim_heap(a, bp);
+  }
+  if (!trimmed && size >= RELEASE_MIN) {
+      release_later(a, bp, lo, hi);
+  }
+  if (a->npending > 0) {
+      release_due(a);
+  }
+}
+
+//
+// release_later - Queue free block bp of arena a, of which [lo, hi) is
+//                 not released yet, to have its pages released once it
+//                 has stayed free across RELEASE_DELAY more frees
+//
+// With every slot taken, the block that has waited longest goes now.
+//
+static void release_later(arena_t *a, void *bp, char *lo, char *hi)
+{
+  release_t *r = a->pending;
+  int i;
+
+  if (a->npending == RELEASE_SLOTS) {
+      for (i = 1; i < RELEASE_SLOTS; i++) {
+          if (a->pending[i].due < r->due) {
+              r = &a->pending[i];
+          }
+      }
+      release_slot(a, r);
+  }
+  for (r = a->pending; r->bp != NULL; r++) {
+  }
+  r->bp = bp;
+  r->lo = lo;
+  r->hi = hi;
+  r->due = a->frees + RELEASE_DELAY;
+  a->npending++;
+}
+
+//
+// release_due - Give back every block of arena a whose wait is over
+//
+static void release_due(arena_t *a)
+{
+  release_t *r;
+
+  for (r = a->pending; r < a->pending + RELEASE_SLOTS; r++) {
+      if (r->bp != NULL && r->due <= a->frees) {
+          release_slot(a, r);
+      }
+  }
+}
+
+//
+// release_slot - Empty slot r of arena a and release its block's pages
+//
+static void release_slot(arena_t *a, release_t *r)
+{
+  release_pages(r->bp, r->lo, r->hi);
+  r->bp = NULL;
+  a->npending--;
+}
+
+//
+// pending_of - The slot of free block bp of arena a if it is waiting to
+//              be released, otherwise NULL
+//
+static release_t *pending_of(arena_t *a, void *bp)
+{
+  release_t *r;
+
+  for (r = a->pending; r < a->pending + RELEASE_SLOTS; r++) {
+      if (r->bp == bp) {
+          return r;
+      }
+  }
+  return NULL;
+}
+
+//
+// trim_heap - Cut free block bp of arena a down to TRIM_KEEP bytes and
+//             move the brk down if bp ends the heap; returns whether it did
+//
+static int trim_heap(arena_t *a, void *bp)
+{
+  uint32_t size = GET_SIZE(HDRP(bp));
+  uint32_t cut = 0;
+
+  pthread_mutex_lock(&heap_lock);
+  if (tail_arena == a && (char *)NEXT_BLKP(bp) == (char *)mem_heap_hi() + 1) {
+      cut = size - TRIM_KEEP;
+      remove_free(a, bp);
+      mem_sbrk(-(intptr_t)cut);
+      PUT(HDRP(bp), PACK(TRIM_KEEP, GET_PREV_ALLOC(HDRP(bp)), 0));
+      PUT(FTRP(bp), PACK(TRIM_KEEP, 0, 0));
+      PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 0, 1)); /* New epilogue header */
+      insert_free(a, bp);
+  }
+  pthread_mutex_unlock(&heap_lock);
+
+  if (cut > 0) {
+      EVENT(MM_EV_TRIM, cut);
+  }
+  return cut > 0;
+}
+
+//
+// release_pages - Release the whole pages of [lo, hi), the part of free
+//                 block bp that was not released yet, short of its links
+//                 and its footer; bp keeps its place in the heap
+//
+static void release_pages(void *bp, char *lo, char *hi)
+{
+  // a neighbor coalesce left alone is not part of bp
+  if (lo < (char *)bp + 2*WSIZE) {
+      lo = (char *)bp + 2*WSIZE;
+  }
+  if (hi > (char *)FTRP(bp)) {
+      hi = (char *)FTRP(bp);
+  }
+  if (lo < hi) {
+      mem_release(lo, hi - lo);
+  }
+}
+
+//
+// coalesce - boundary tag coalescing. Return ptr to coalesced block
+// Any free neighbor is taken off its free list before the merge and the
+// merged block is put back on the list for its new size.
+//
+static void *coalesce(arena_t *a, void *bp)
+{
+  // Page 885, Figure 9.46
+  // get allocation of previous block from our own header, its footer is only there when it's free
+  // get size of next block from header
+  // get size of current block from header
+  size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+  size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+  size_t size = GET_SIZE(HDRP(bp));
+
+  // a free neighbor that would take the size past SIZE_MAX32 is left
+  // alone, as if it were allocated
+  if (!next_alloc && size + GET_SIZE(HDRP(NEXT_BLKP(bp))) > SIZE_MAX32) {
+      next_alloc = 1;
+  }
+  if (!prev_alloc && size + GET_SIZE((char *)bp - DSIZE) +
+      (next_alloc ? 0 : GET_SIZE(HDRP(NEXT_BLKP(bp)))) > SIZE_MAX32) {
+      prev_alloc = 1;
+  }
+
+  // Case 1: prev and next blocks are both allocated
+  // Nothing to merge, the block just goes on its free list
+  if (prev_alloc && next_alloc) {
+      EVENT(MM_EV_COALESCE1, 0);
+  }
+
+  // Case 2: prev block is allocated and next block is free
+  // Merge current block and next block
+  // Update header of current block and footer of next block
+  // New size = combined sizes of the curr and next blocks
+  else if (prev_alloc && !next_alloc) {
+      // get next blocks header and incr size
+      // update header & footer of newly combined block to be unallocated -> 0
+      EVENT(MM_EV_COALESCE2, 0);
+      remove_free(a, NEXT_BLKP(bp));
+      absorb(a, NEXT_BLKP(bp), bp);
+      size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+      PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)), 0));
+      PUT(FTRP(bp), PACK(size, 0, 0));
+  }
+
+  // Case 3: prev block is free and next block is allocated
+  // Merge previous and current blocks
+  // Update header of previous block and footer of current block
+  // New size = combined sizes of the previous and curr blocks
+  else if (!prev_alloc && next_alloc) {
+      // get previous blocks header and incr size
+      // update header & footer of newly combined block to be unallocated -> 0
+      // update pointer so it is now at previous block to account for 1 newly combined unallocated block
+      EVENT(MM_EV_COALESCE3, 0);
+      remove_free(a, PREV_BLKP(bp));
+      absorb(a, bp, PREV_BLKP(bp));
+      size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+      PUT(FTRP(bp), PACK(size, 0, 0));
+      PUT(HDRP(PREV_BLKP(bp)), PACK(size, GET_PREV_ALLOC(HDRP(PREV_BLKP(bp))), 0));
+      bp = PREV_BLKP(bp);
+  }
+
+  // Case 4: prev block is free and next block is free
+  // Merge previous, curr and next blocks
+  // Update header of prev block and footer of next block
+  // New size = combined sizes of the prev, curr, and next blocks
+  else {
+      // get previous blocks header & next blocks footer, and incr size to perform merge
+      // update header & footer of newly combined block to be unallocated -> 0
+      // update pointer so it is now at previous block to account for 1 newly combined unallocated block
+      EVENT(MM_EV_COALESCE4, 0);
+      remove_free(a, PREV_BLKP(bp));
+      remove_free(a, NEXT_BLKP(bp));
+      absorb(a, bp, PREV_BLKP(bp));
+      absorb(a, NEXT_BLKP(bp), PREV_BLKP(bp));
+      size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
+      PUT(HDRP(PREV_BLKP(bp)), PACK(size, GET_PREV_ALLOC(HDRP(PREV_BLKP(bp))), 0));
+      PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0, 0));
+      bp = PREV_BLKP(bp);
+  }
+
+  // whatever follows the merged block now has a free block in front of it
+  CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+  insert_free(a, bp);
+
+  // return pointer to current block
+  return bp;
+}
+
+
+
+//
+// mm_malloc - Allocate a block with at least size bytes of payload
+// An application requests a block of size bytes of memory by calling the mm_malloc function
+void *mm_malloc(size_t size)
+{
+  arena_t *a;
+  char *bp; // block pointer
+  // Ignore size extension if trival
+  if (size == 0) {
+      return NULL;
+  }
+
+  // a recently freed small block needs no lock at all
+  if (size <= SLAB_MAX && (bp = tcache_get(size)) != NULL) {
+      return bp;
+  }
+
+  // a huge one gets its own mapping, or failing that comes off the heap
+  if (size >= HUGE_MIN && (bp = huge_malloc(size, ALIGNMENT)) != NULL) {
+      return bp;
+  }
+  if (size > BLOCK_MAX) {
+      return NULL;
+  }
+
+  a = thread_arena();
+  pthread_mutex_lock(&a->lock);
+  drain_remote(a);
+  bp = arena_malloc(a, size);
+  pthread_mutex_unlock(&a->lock);
+  return bp;
+}
+
+//
+// mm_memalign - Allocate a block with at least size bytes of payload
+//               starting on an align byte boundary (a power of two)
+// Up to ALIGNMENT every block qualifies. Beyond that alloc_aligned carves
+// the block out of a larger free one and hands the lead-in and the tail
+// back to the free lists, so the padding is only borrowed. A huge block
+// just starts its payload further into its mapping.
+//
+void *mm_memalign(size_t align, size_t size)
+{
+  arena_t *a;
+  char *bp;
+
+  if (align == 0 || (align & (align - 1)) != 0) {
+      return NULL;
+  }
+  if (align <= ALIGNMENT) {
+      return mm_malloc(size);
+  }
+  if (size == 0) {
+      return NULL;
+  }
+
+  if (size >= HUGE_MIN && align <= mem_pagesize() &&
+      (bp = huge_malloc(size, align)) != NULL) {
+      return bp;
+  }
+  if (size > BLOCK_MAX || align > BLOCK_MAX - size) {
+      return NULL;
+  }
+
+  a = thread_arena();
+  pthread_mutex_lock(&a->lock);
+  drain_remote(a);
+  if ((bp = alloc_aligned(a, adjust_size(size), align)) != NULL) {
+      track_small(a, GET_SIZE(HDRP(bp)), 1);
+  }
+  pthread_mutex_unlock(&a->lock);
+  return bp;
+}
+
+//
+// mm_malloc_flags - Allocate a block with at least size bytes of payload,
+//                   placed as the MM_LINE_xxx flags ask
+//
+// MM_LINE_NOCROSS keeps the payload from spanning more cache lines than
+// its size needs, whether or not line-aware placement is on.
+// MM_LINE_EXCLUSIVE starts it on a line boundary and rounds the block up
+// so that the next payload starts on a line of its own, and bypasses the
+// thread cache and slabs, whose neighbors would share the lines.
+//
+void *mm_malloc_flags(size_t size, int flags)
+{
+  arena_t *a;
+  char *bp;
+  uint32_t asize;
+
+  if (!(flags & (MM_LINE_NOCROSS | MM_LINE_EXCLUSIVE)) || size == 0) {
+      return mm_malloc(size);
+  }
+  if (flags & MM_LINE_EXCLUSIVE && size >= HUGE_MIN &&
+      (bp = huge_malloc(size, CACHE_LINE)) != NULL) {
+      return bp;
+  }
+  if (size > BLOCK_MAX - CACHE_LINE) {
+      return NULL;
+  }
+
+  a = thread_arena();
+  pthread_mutex_lock(&a->lock);
+  drain_remote(a);
+  if (flags & MM_LINE_EXCLUSIVE) {
+      asize = (size + OVERHEAD + CACHE_LINE - 1) & ~(uint32_t)(CACHE_LINE - 1);
+      bp = alloc_aligned(a, asize, CACHE_LINE);
+  }
+  else if (size <= CACHE_LINE) {
+      bp = alloc_line(a, adjust_size(size), size);
+  }
+  else {
+      bp = alloc_aligned(a, adjust_size(size), CACHE_LINE);
+  }
+  if (bp != NULL) {
+      track_small(a, GET_SIZE(HDRP(bp)), 1);
+  }
+  pthread_mutex_unlock(&a->lock);
+  return bp;
+}
+
+//
+// arena_malloc - Allocate size bytes from arena a; a's lock must be held
+//
+static void *arena_malloc(arena_t *a, uint32_t size)
+{
+  char *bp; // block pointer
+  uint32_t asize;
+
+  // small requests come out of a slab run once their size is in demand
+  if (size <= SLAB_MAX && slab_wanted(a, size)) {
+      return slab_alloc(a, SLAB_CLASS(size));
+  }
+
+  /* Adjust block size to include overhead and alignment reqs. */
+  asize = adjust_size(size);
+
+  // a block of exactly this size waiting on a quick list needs no search
+  bp = asize <= QUICK_MAX ? a->quick[asize / ALIGNMENT] : NULL;
+  if (bp != NULL && !(line_mode && size <= CACHE_LINE && CROSSES_LINE(bp, size))) {
+      a->quick[asize / ALIGNMENT] = *(char **)bp;
+      a->quick_count--;
+  }
+  else if (line_mode && size <= CACHE_LINE) {
+      bp = alloc_line(a, asize, size);
+  }
+  else {
+      bp = alloc_block(a, asize);
+  }
+  if (bp != NULL) {
+      track_small(a, GET_SIZE(HDRP(bp)), 1);
+  }
+  return bp;
+}
+
+//
+// huge_malloc - Map a huge block with room for size bytes of payload
+//               aligned to align (at most a page), or return NULL if
+//               the mapping region is full
+//
+static void *huge_malloc(size_t size, size_t align)
+{
+  size_t off = align > HUGE_PAD ? align : HUGE_PAD;
+  size_t len = (size + off + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+  char *p;
+
+  if (len < size || (p = mem_map(len)) == NULL) {
+      return NULL;
+  }
+  SET_HUGE_LEN(p + off, len);
+  return p + off;
+}
+
+//
+// alloc_block - Allocate a block of asize bytes from the free lists,
+//               extending the heap if none of them has a fit
+//
+static void *alloc_block(arena_t *a, uint32_t asize)
+{
+  char *bp; // block pointer
+
+  /* Search the free list for a fit */
+  // If there is a fit, then the allocator places the requested block and optionally splits the excess
+  // return block pointer to newly allocated block
+  if ((bp = find_fit(a, asize)) != NULL) {
+      place(a, bp, asize);
+      return bp;
+  }
+
+  // Blocks waiting on the quick lists may merge into a fit
+  if (a->quick_count > 0) {
+      quick_flush(a);
+      if ((bp = find_fit(a, asize)) != NULL) {
+          place(a, bp, asize);
+          return bp;
+      }
+  }
+
+  /* No fit found. Get more memory and place the block */
+  // extends the heap with a new free block, places the requested block in the new free block
+  if ((bp = extend_heap(a, asize)) == NULL) {
+      return NULL;
+  }
+  place(a, bp, asize);
+  return bp;
+}
+
+//
+// alloc_aligned - Allocate a block of asize bytes whose payload starts on
+//                 an align byte boundary (align is a power of two)
+//
+// Over-allocate so that an aligned payload with room for a free block in
+// front of it has to fit, then give back the lead-in and the tail.
+//
+static void *alloc_aligned(arena_t *a, uint32_t asize, uint32_t align)
+{
+  char *bp, *p;
+  uint32_t csize, front;
+
+  if ((bp = alloc_block(a, asize + align + MIN_BLOCK)) == NULL) {
+      return NULL;
+  }
+
+  p = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+  if (p != bp && p - bp < MIN_BLOCK) {
+      p += align;
+  }
+
+  // the lead-in becomes a free block of its own
+  if (p != bp) {
+      csize = GET_SIZE(HDRP(bp));
+      front = p - bp;
+      PUT(HDRP(bp), PACK(front, GET_PREV_ALLOC(HDRP(bp)), 0));
+      PUT(FTRP(bp), PACK(front, 0, 0));
+      PUT(HDRP(p), PACK(csize - front, 0, 1));
+      coalesce(a, bp);
+  }
+
+  split_block(a, p, asize);
+  return p;
+}
+
+
+
+//
+//
+// alloc_line - Allocate a block of asize bytes whose first size bytes,
+//              no more than a cache line, do not straddle two of them
+//
+// The fit is taken as it is when it already starts far enough from the
+// end of its line. Otherwise the payload moves up to the next line
+// boundary, and the lead-in is left free for blocks that fit in it.
+//
+static void *alloc_line(arena_t *a, uint32_t asize, uint32_t size)
+{
+  char *bp;
+
+  if ((bp = find_fit(a, asize)) != NULL && !CROSSES_LINE(bp, size)) {
+      place(a, bp, asize);
+      return bp;
+  }
+  return alloc_aligned(a, asize, CACHE_LINE);
+}
+
+
+
+//
+// Practice problem 9.9
+//
+// place - Place block of asize bytes at start of free block bp
+//         and split if remainder would be at least minimum block size
+//
+static void place(arena_t *a, void *bp, uint32_t asize)
+{
+  // initialize size of bp
+  size_t csize = GET_SIZE(HDRP(bp));
+
+  // bp is about to be allocated, take it off its free list
+  remove_free(a, bp);
+  touch(a, bp);
+
+  // if the remainder is big enough to be a block of its own, split it off
+  // and put it back on the free list for its (smaller) size
+  // (a free block always follows an allocated one, so its prev-alloc bit is set)
+  if ((csize - asize) >= MIN_BLOCK) {
+      EVENT(MM_EV_SPLIT, 0);
+      PUT(HDRP(bp), PACK(asize, 1, 1));
+      bp = NEXT_BLKP(bp);
+      PUT(HDRP(bp), PACK(csize - asize, 1, 0));
+      PUT(FTRP(bp), PACK(csize - asize, 0, 0));
+      insert_free(a, bp);
+  }
+
+  // otherwise hand out the whole block, and tell the next block about it
+  else {
+      PUT(HDRP(bp), PACK(csize, 1, 1));
+      SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+  }
+}
+
+
+
+//
+// mm_realloc - Resize the block at ptr to hold size bytes of payload
+// The block is resized in place whenever the boundary tags allow it:
+//   (1) shrinking splits the tail off as a new free block
+//   (2) growing absorbs a free next neighbor that is big enough
+//   (3) growing at the end of the heap extends the heap by only the
+//       missing bytes and absorbs them like case (2)
+// A huge block that stays huge is remapped instead.
+// Only when none of these apply do we fall back to malloc + copy + free.
+//
+void *mm_realloc(void *ptr, size_t size)
+{
+  arena_t *a;
+  void *newp;
+  size_t copySize;
+
+  if (ptr == NULL) {
+    return mm_malloc(size);
+  }
+  if (size == 0) {
+    mm_free(ptr);
+    return NULL;
+  }
+
+  // a huge block is resized by remapping its pages; one that is no
+  // longer huge moves back to the heap below
+  if (IS_HUGE(ptr)) {
+    if (size >= HUGE_MIN && (newp = huge_realloc(ptr, size)) != NULL) {
+      return newp;
+    }
+  }
+
+  // the in-place cases rearrange the owning arena's blocks, whichever
+  // thread is asking
+  else if (size <= BLOCK_MAX) {
+    a = arena_of(ptr);
+    pthread_mutex_lock(&a->lock);
+    newp = arena_realloc(a, ptr, size);
+    pthread_mutex_unlock(&a->lock);
+    if (newp != NULL) {
+      return newp;
+    }
+  }
+
+  // No room in place: move the payload to a new block
+  if ((newp = mm_malloc(size)) == NULL) {
+    return NULL;
+  }
+  copySize = usable_size(ptr);
+  if (size < copySize) {
+    copySize = size;
+  }
+  memcpy(newp, ptr, copySize);
+  mm_free(ptr);
+  return newp;
+}
+
+//
+// huge_realloc - Resize huge block ptr to hold size bytes of payload,
+//                moving its pages if need be; NULL if there is no room
+//
+static void *huge_realloc(void *ptr, size_t size)
+{
+  size_t off = (char *)ptr - HUGE_BASE(ptr);
+  size_t len = (size + off + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+  size_t oldlen = HUGE_LEN(ptr);
+  char *p;
+
+  if (len == oldlen) {
+    return ptr;
+  }
+  if (len < size || (p = mem_remap(HUGE_BASE(ptr), oldlen, len)) == NULL) {
+    return NULL;
+  }
+  SET_HUGE_LEN(p + off, len);
+  return p + off;
+}
+
+//
+// arena_realloc - Resize ptr of arena a in place, or return NULL if it
+//                 has to move; a's lock must be held
+//
+static void *arena_realloc(arena_t *a, void *ptr, uint32_t size)
+{
+  void *next, *endp;
+  uint32_t asize, oldsize, nextsize;
+
+  // A slab slot cannot change size: keep it if it is still big enough,
+  // otherwise the payload has to move out
+  if (slab_class_of(ptr) >= 0) {
+    return size <= usable_size(ptr) ? ptr : NULL;
+  }
+
+  asize = adjust_size(size);
+  oldsize = GET_SIZE(HDRP(ptr));
+
+  // a small payload that would straddle two cache lines where it is has
+  // to move to one that keeps it within a line
+  if (line_mode && size <= CACHE_LINE && CROSSES_LINE(ptr, size)) {
+    return NULL;
+  }
+
+  // Case 1: the block is already big enough, give back any excess
+  if (asize <= oldsize) {
+    shrink_block(a, ptr, asize);
+    track_small(a, oldsize, -1);
+    track_small(a, GET_SIZE(HDRP(ptr)), 1);
+    return ptr;
+  }
+
+  next = NEXT_BLKP(ptr);
+  nextsize = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+  endp = nextsize ? NEXT_BLKP(next) : next;
+
+  // Case 3: the block (possibly followed by one free block) ends the heap,
+  // so ask for just the bytes we are missing. heap_grow coalesces the new
+  // space with the free next block, which turns this into case 2. A
+  // segment that another arena has since built on top of cannot grow.
+  if (oldsize + nextsize < asize && GET_SIZE(HDRP(endp)) == 0) {
+    pthread_mutex_lock(&heap_lock);
+    if ((char *)endp == (char *)mem_heap_hi() + 1) {
+      // a free block can be no smaller than MIN_BLOCK, even for a few bytes
+      if (heap_grow(a, MAX(asize - oldsize - nextsize, MIN_BLOCK)) != NULL) {
+        nextsize = GET_SIZE(HDRP(next));
+      }
+    }
+    pthread_mutex_unlock(&heap_lock);
+  }
+
+  // Case 2: absorb the free next neighbor and trim whatever is left over
+  if (oldsize + nextsize >= asize) {
+    remove_free(a, next);
+    absorb(a, next, ptr);
+    touch(a, ptr);
+    PUT(HDRP(ptr), PACK(oldsize + nextsize, GET_PREV_ALLOC(HDRP(ptr)), 1));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+    shrink_block(a, ptr, asize);
+    track_small(a, oldsize, -1);
+    track_small(a, GET_SIZE(HDRP(ptr)), 1);
+    return ptr;
+  }
+  return NULL;
+}
+
+//
+// shrink_block - Cut allocated block bp down to asize bytes and free the
+//                remainder if it would be at least minimum block size
+//
+// A block that ends the heap keeps up to CHUNKSIZE of slack instead: a
+// freed tail would just be handed to the next small malloc, which then
+// pins the block in place and forces the next growing realloc to copy.
+// The slack is no more than a trim leaves at the top (TRIM_KEEP).
+//
+static void shrink_block(arena_t *a, void *bp, uint32_t asize)
+{
+  uint32_t csize = GET_SIZE(HDRP(bp));
+
+  if (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0 && (csize - asize) < CHUNKSIZE) {
+    return;
+  }
+  split_block(a, bp, asize);
+}
+
+//
+// split_block - Cut allocated block bp down to asize bytes and free the
+//               remainder if it would be at least minimum block size
+//
+static void split_block(arena_t *a, void *bp, uint32_t asize)
+{
+  uint32_t csize = GET_SIZE(HDRP(bp));
+
+  touch(a, bp);
+  if ((csize - asize) >= MIN_BLOCK) {
+    EVENT(MM_EV_SPLIT, 0);
+    PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)), 1));
+    bp = NEXT_BLKP(bp);
+    PUT(HDRP(bp), PACK(csize - asize, 1, 0));
+    PUT(FTRP(bp), PACK(csize - asize, 0, 0));
+    // the remainder may border a free block, merge it before listing it
+    coalesce(a, bp);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Slab front end
+//
+/////////////////////////////////////////////////////////////////////////////
+
+//
+// track_small - Count a regular block of bsize bytes as allocated (+1) or
+//               freed (-1) toward its size's SLAB_WARMUP threshold
+//
+static void track_small(arena_t *a, uint32_t bsize, int delta)
+{
+  if (bsize <= SLAB_TRACK_MAX) {
+    a->small_live[bsize / DSIZE] += delta;
+  }
+}
+
+//
+// slab_wanted - Should a request of size bytes come from a slab run?
+// A run costs a whole SLAB_RUN, which is only worth paying once enough
+// blocks of this size are live at the same time. After that the class
+// stays on slabs until the next mm_init.
+//
+static int slab_wanted(arena_t *a, uint32_t size)
+{
+  int class = SLAB_CLASS(size);
+
+  // slots that do not divide a cache line would straddle lines
+  if (line_mode && CACHE_LINE % SLAB_SLOT(class) != 0) {
+    return 0;
+  }
+  if (!a->slab_on[class] && a->small_live[adjust_size(size) / DSIZE] >= SLAB_WARMUP) {
+    a->slab_on[class] = 1;
+  }
+  return a->slab_on[class];
+}
+
+//
+// slab_alloc - Hand out a free slot of the given class in O(1)
+//
+static void *slab_alloc(arena_t *a, int class)
+{
+  slab_t *run = a->slab_partial[class];
+  int w, bit;
+
+  if (run == NULL && (run = slab_new_run(a, class)) == NULL) {
+    return NULL;
+  }
+  touch(a, run);
+
+  // nfree > 0, so some word at or above the hint has a set bit
+  for (w = run->hint; run->freemap[w] == 0; w++) {
+  }
+  bit = __builtin_ctzll(run->freemap[w]);
+  run->freemap[w] &= run->freemap[w] - 1;
+  run->hint = w;
+
+  // a full run has nothing to offer, drop it from the partial list
+  if (--run->nfree == 0) {
+    slab_unlink(a, run);
+  }
+  return SLAB_SLOTS(run) + (w * 64 + bit) * SLAB_SLOT(class);
+}
+
+//
+// slab_free - Return slot p of the given class to its run in O(1)
+//
+static void slab_free(arena_t *a, void *p, int class)
+{
+  slab_t *run = SLAB_RUNP(p);
+  int slot = ((char *)p - SLAB_SLOTS(run)) / SLAB_SLOT(class);
+  int w = slot / 64;
+
+  touch(a, run);
+  run->freemap[w] |= (uint64_t)1 << (slot % 64);
+  if (w < run->hint) {
+    run->hint = w;
+  }
+
+  // a run that was full is usable again
+  if (run->nfree++ == 0) {
+    slab_push(a, run);
+  }
+
+  // an empty run goes back to the heap, unless it is the last one the
+  // class has left (keeps alloc/free at the boundary from thrashing runs)
+  else if (run->nfree == run->nslots && (run->prev || run->next)) {
+    slab_unlink(a, run);
+    slab_map[MAP_INDEX(run)] = 0;
+    free_block(a, run);
+  }
+}
+
+//
+// slab_new_run - Carve a new run for the given class out of the heap
+//
+static slab_t *slab_new_run(arena_t *a, int class)
+{
+  slab_t *run;
+  int i, n;
+
+  if ((run = alloc_aligned(a, SLAB_RUN, SLAB_RUN)) == NULL) {
+    return NULL;
+  }
+
+  n = (SLAB_RUN - OVERHEAD - (SLAB_SLOTS(run) - (char *)run)) / SLAB_SLOT(class);
+  run->class = class;
+  run->nslots = n;
+  run->nfree = n;
+  run->hint = 0;
+  for (i = 0; i < SLAB_MAPWORDS; i++, n -= 64) {
+    run->freemap[i] = (n >= 64) ? ~(uint64_t)0 : (n > 0) ? ((uint64_t)1 << n) - 1 : 0;
+  }
+
+  slab_map[MAP_INDEX(run)] = class + 1;
+  slab_push(a, run);
+  return run;
+}
+
+//
+// slab_push - Put run at the front of its class's partial list
+//
+static void slab_push(arena_t *a, slab_t *run)
+{
+  slab_t *head = a->slab_partial[run->class];
+
+  run->prev = 0;
+  run->next = PTR2OFF(head);
+  if (head != NULL) {
+    head->prev = PTR2OFF(run);
+  }
+  a->slab_partial[run->class] = run;
+}
+
+//
+// slab_unlink - Take run off its class's partial list
+//
+static void slab_unlink(arena_t *a, slab_t *run)
+{
+  slab_t *prev = (slab_t *)OFF2PTR(run->prev);
+  slab_t *next = (slab_t *)OFF2PTR(run->next);
+
+  if (prev != NULL) {
+    prev->next = run->next;
+  }
+  else {
+    a->slab_partial[run->class] = next;
+  }
+  if (next != NULL) {
+    next->prev = run->prev;
+  }
+}
+
+//
+// mm_set_lines - Turn line-aware placement on or off from the next mm_init on
+//
+void mm_set_lines(int on)
+{
+  next_line_mode = on != 0;
+}
+
+//
+// mm_set_defer - Turn deferred coalescing on or off from the next mm_init on
+//
+void mm_set_defer(int on)
+{
+  next_defer = on != 0;
+}
+
+//
+// mm_set_fit - Choose the placement policy from the next mm_init on
+//
+void mm_set_fit(int policy)
+{
+  if (policy >= 0 && policy < MM_NUM_FITS) {
+    next_policy = policy;
+  }
+}
+
+//
+// mm_fitstats - Sum every arena's fit statistics since the last call
+//               (or mm_init) and start counting afresh
+//
+void mm_fitstats(mm_fitstats_t *fs)
+{
+  arena_t *a;
+  int i, b;
+
+  memset(fs, 0, sizeof(*fs));
+  for (i = 0; i < NUM_ARENAS; i++) {
+    a = &arenas[i];
+    pthread_mutex_lock(&a->lock);
+    fs->searches += a->fit.searches;
+    fs->probes += a->fit.probes;
+    if (a->fit.max > fs->max) {
+      fs->max = a->fit.max;
+    }
+    for (b = 0; b < MM_PROBE_BUCKETS; b++) {
+      fs->hist[b] += a->fit.hist[b];
+    }
+    memset(&a->fit, 0, sizeof(a->fit));
+    pthread_mutex_unlock(&a->lock);
+  }
+}
+
+#if MM_EVENTS
+//
+// mm_events - Copy out the event counts since the last call (or mm_init)
+//             and start counting afresh
+//
+void mm_events(mm_events_t *ev)
+{
+  *ev = events;
+  memset(&events, 0, sizeof(events));
+}
+
+//
+// mm_heapstat - Measure the free space of every arena's free lists
+// Blocks parked in a tcache or on a remote stack still count as allocated.
+//
+void mm_heapstat(mm_heapstat_t *hs)
+{
+  arena_t *a;
+  char *bp;
+  uint32_t size;
+  int i, bin;
+
+  memset(hs, 0, sizeof(*hs));
+  hs->heap_bytes = mem_heapsize();
+  for (i = 0; i < NUM_ARENAS; i++) {
+    a = &arenas[i];
+    pthread_mutex_lock(&a->lock);
+    for (bin = next_bin(a, -1); bin >= 0; bin = next_bin(a, bin)) {
+      for (bp = a->free_lists[bin]; bp != NULL; bp = SUCC(bp)) {
+        size = GET_SIZE(HDRP(bp));
+        hs->free_bytes += size;
+        hs->free_blocks++;
+        if (size > hs->largest_free) {
+          hs->largest_free = size;
+        }
+      }
+    }
+    pthread_mutex_unlock(&a->lock);
+  }
+}
+#endif
+
+//
+// mm_checkheap - Check the whole heap for consistency and return the
+//                number of errors found, printing each of them
+//
+// The block walk checks every block's tags and prev-alloc bit, catches
+// two free neighbors that coalesce should have merged, and counts the
+// free blocks. The free lists must hold exactly those blocks.
+//
+int mm_checkheap(int verbose)
 {
-  //
-  // This provided implementation assumes you're using the structure
-  // of the sample solution in the text. If not, omit this code
-  // and provide your own mm_checkheap
-  //
   void *bp = heap_listp;
-  
+  int prev_alloc = 1;
+  uint32_t prev_size = 0;
+  long nfree = 0, listed = 0;
+  arena_t *a;
+  slab_t *run;
+  int i, j, n;
+
+  check_errors = 0;
   if (verbose) {
     printf("Heap (%p):\n", heap_listp);
   }
 
-  if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp))) {
-	printf("Bad prologue header\n");
+  if ((GET_SIZE(HDRP(heap_listp)) != ALIGNMENT) || !GET_ALLOC(HDRP(heap_listp))) {
+	report("Bad prologue header\n");
   }
   checkblock(heap_listp);
 
-  for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-    if (verbose)  {
+  // walk every segment; the one that ends at the brk is the last
+  for (;;) {
+    for (; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+      if (verbose)  {
+        printblock(bp);
+      }
+      checkblock(bp);
+      if (GET_PREV_ALLOC(HDRP(bp)) != prev_alloc) {
+        report("Error: %p has a stale prev-alloc bit\n", bp);
+      }
+      if (!GET_ALLOC(HDRP(bp))) {
+        nfree++;
+        if (!prev_alloc && (size_t)prev_size + GET_SIZE(HDRP(bp)) <= SIZE_MAX32) {
+          report("Error: %p and the free block before it were not coalesced\n", bp);
+        }
+      }
+      prev_alloc = GET_ALLOC(HDRP(bp));
+      prev_size = GET_SIZE(HDRP(bp));
+    }
+
+    if (verbose) {
       printblock(bp);
     }
-    checkblock(bp);
+
+    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp)))) {
+      report("Bad epilogue header\n");
+    }
+    if (GET_PREV_ALLOC(HDRP(bp)) != prev_alloc) {
+      report("Error: epilogue has a stale prev-alloc bit\n");
+    }
+    if ((char *)bp > (char *)mem_heap_hi()) {
+      break;
+    }
+
+    // the next segment's first block follows its pad on the next page
+    bp = (char *)(((uintptr_t)bp + MAP_PAGE - 1) & ~(uintptr_t)(MAP_PAGE - 1)) + ALIGNMENT;
+    prev_alloc = 1;
   }
-     
-  if (verbose) {
-    printblock(bp);
+
+  // every free block must be on its arena's lists, and nothing else; a
+  // list that runs past nfree blocks has a loop or a stray entry
+  for (j = 0; j < NUM_ARENAS; j++) {
+    listed += check_lists(&arenas[j], nfree - listed);
+  }
+  if (listed != nfree) {
+    report("Error: the heap has %ld free blocks, the free lists %ld\n", nfree, listed);
+  }
+
+  // every partial slab run must be mapped and agree with its bitmap,
+  // every block on a quick list must be allocated and of the list's size,
+  // and every release slot must hold a free block of RELEASE_MIN or more
+  for (j = 0; j < NUM_ARENAS; j++) {
+    a = &arenas[j];
+    n = 0;
+    for (i = 0; i < QUICK_CLASSES; i++) {
+      for (bp = a->quick[i]; bp != NULL; bp = *(char **)bp, n++) {
+        if (!GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) != (uint32_t)i * ALIGNMENT) {
+          report("Error: %p is on the wrong quick list\n", bp);
+        }
+      }
+    }
+    if (n != a->quick_count) {
+      report("Error: arena %d counts %d quick blocks, its lists have %d\n",
+             j, a->quick_count, n);
+    }
+    n = 0;
+    for (i = 0; i < RELEASE_SLOTS; i++) {
+      if ((bp = a->pending[i].bp) != NULL) {
+        n++;
+        if (GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) < RELEASE_MIN) {
+          report("Error: %p waits to be released but is not a big free block\n", bp);
+        }
+      }
+    }
+    if (n != a->npending) {
+      report("Error: arena %d counts %d blocks waiting to be released, its slots have %d\n",
+             j, a->npending, n);
+    }
+    for (i = 0; i < SLAB_CLASSES; i++) {
+      for (run = a->slab_partial[i]; run != NULL; run = (slab_t *)OFF2PTR(run->next)) {
+        if (slab_class_of(run) != i || run->class != i || arena_of(run) != a) {
+          report("Error: slab run %p is on the wrong class list\n", run);
+        }
+        if (run->nfree == 0) {
+          report("Error: slab run %p is full but on the partial list\n", run);
+        }
+        check_run(run);
+      }
+    }
+    if (track_touched) {
+      a->ntouched = 0;
+    }
+  }
+  return check_errors;
+}
+
+//
+// mm_checkrecent - Check only what changed since the last check and
+//                  return the number of errors found
+//
+// Operations note the blocks they place, split, merge or free in their
+// arena's touched list (only once this has been called). Each of those
+// is checked with its neighbors, and a free block against its free
+// list through its own links, in constant time. An arena that touched
+// more than TOUCH_MAX blocks, as a batch coalesce does, gets a full
+// check instead. Not for use while other threads allocate.
+//
+int mm_checkrecent(int verbose)
+{
+  arena_t *a;
+  int i, j;
+
+  track_touched = 1;
+  for (j = 0; j < NUM_ARENAS; j++) {
+    if (arenas[j].ntouched > TOUCH_MAX) {
+      return mm_checkheap(verbose);
+    }
+  }
+
+  check_errors = 0;
+  for (j = 0; j < NUM_ARENAS; j++) {
+    a = &arenas[j];
+    for (i = 0; i < a->ntouched; i++) {
+      if (verbose) {
+        printblock(a->touched[i]);
+      }
+      check_near(a, a->touched[i]);
+    }
+    a->ntouched = 0;
+  }
+  return check_errors;
+}
+
+//
+// report - Print one error found by a check and count it
+//
+static void report(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  check_errors++;
+}
+
+//
+// in_heap - Could p be a block in the heap?
+//
+static inline ALWAYS_INLINE int in_heap(void *p)
+{
+  return (char *)p > heap_listp && (char *)p <= (char *)mem_heap_hi();
+}
+
+//
+// check_lists - Check every free list of arena a and its bitmap, and
+//               return how many blocks are listed; give up past limit
+//
+static long check_lists(arena_t *a, long limit)
+{
+  char *bp, *pred;
+  long n = 0;
+  int bin, bit;
+
+  for (bin = 0; bin < NUM_BINS; bin++) {
+    bit = (a->bin_bitmap[bin / 64] >> (bin % 64)) & 1;
+    if (bit != (a->free_lists[bin] != NULL)) {
+      report("Error: arena %d bin %d has bitmap bit %d\n", a->id, bin, bit);
+    }
+    pred = NULL;
+    for (bp = a->free_lists[bin]; bp != NULL; pred = bp, bp = SUCC(bp)) {
+      if (++n > limit) {
+        report("Error: arena %d lists more free blocks than the heap has\n", a->id);
+        return n;
+      }
+      if (!in_heap(bp)) {
+        report("Error: arena %d bin %d links to %p, outside the heap\n", a->id, bin, bp);
+        break;
+      }
+      if (GET_ALLOC(HDRP(bp))) {
+        report("Error: %p is on a free list but allocated\n", bp);
+      }
+      if (size_bin(GET_SIZE(HDRP(bp))) != bin || arena_of(bp) != a) {
+        report("Error: %p is on arena %d bin %d, not its own\n", bp, a->id, bin);
+      }
+      if (PRED(bp) != pred) {
+        report("Error: %p has a bad pred link\n", bp);
+      }
+    }
+  }
+  return n;
+}
+
+//
+// check_free - Check that free block bp is linked into its free list,
+//              going by its own links and its list neighbors'
+//
+static void check_free(arena_t *a, char *bp)
+{
+  int bin = size_bin(GET_SIZE(HDRP(bp)));
+  char *pred = PRED(bp);
+  char *succ = SUCC(bp);
+
+  if (arena_of(bp) != a) {
+    report("Error: free block %p is in arena %d, touched by arena %d\n",
+           bp, arena_of(bp)->id, a->id);
+  }
+  if (!((a->bin_bitmap[bin / 64] >> (bin % 64)) & 1)) {
+    report("Error: %p is free but bin %d is marked empty\n", bp, bin);
+  }
+  if (pred == NULL ? a->free_lists[bin] != bp :
+      !in_heap(pred) || GET_ALLOC(HDRP(pred)) || SUCC(pred) != bp) {
+    report("Error: %p is not on its free list\n", bp);
+  }
+  if (succ != NULL && (!in_heap(succ) || GET_ALLOC(HDRP(succ)) || PRED(succ) != bp)) {
+    report("Error: %p has a bad succ link\n", bp);
+  }
+}
+
+//
+// check_near - Check block bp and the blocks on either side of it, and
+//              those of them that are free against their free lists
+//
+static void check_near(arena_t *a, char *bp)
+{
+  char *prev, *next;
+
+  if (!in_heap(bp) || GET_SIZE(HDRP(bp)) == 0) {
+    report("Error: touched block %p is not in the heap\n", bp);
+    return;
+  }
+  checkblock(bp);
+
+  // the previous block can only be found when it is free
+  if (!GET_PREV_ALLOC(HDRP(bp))) {
+    prev = PREV_BLKP(bp);
+    if (!in_heap(prev) || GET_ALLOC(HDRP(prev)) || NEXT_BLKP(prev) != bp) {
+      report("Error: %p has a stale prev-alloc bit\n", bp);
+    }
+    else {
+      checkblock(prev);
+      check_free(a, prev);
+      if (!GET_ALLOC(HDRP(bp)) &&
+          (size_t)GET_SIZE(HDRP(prev)) + GET_SIZE(HDRP(bp)) <= SIZE_MAX32) {
+        report("Error: %p and the free block before it were not coalesced\n", bp);
+      }
+    }
+  }
+
+  next = NEXT_BLKP(bp);
+  if ((char *)next > (char *)mem_heap_hi() + 1) {
+    report("Error: %p runs past the end of the heap\n", bp);
+    return;
+  }
+  if (GET_PREV_ALLOC(HDRP(next)) != GET_ALLOC(HDRP(bp))) {
+    report("Error: %p has a stale prev-alloc bit\n", next);
+  }
+  if (GET_SIZE(HDRP(next)) == 0) {
+    if (!GET_ALLOC(HDRP(next))) {
+      report("Bad epilogue header\n");
+    }
+  }
+  else if (!GET_ALLOC(HDRP(next))) {
+    checkblock(next);
+    check_free(a, next);
+    if (!GET_ALLOC(HDRP(bp)) &&
+        (size_t)GET_SIZE(HDRP(bp)) + GET_SIZE(HDRP(next)) <= SIZE_MAX32) {
+      report("Error: %p and the free block after it were not coalesced\n", bp);
+    }
   }
 
-  if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp)))) {
-    printf("Bad epilogue header\n");
+  if (!GET_ALLOC(HDRP(bp))) {
+    check_free(a, bp);
+  }
+  else if (slab_class_of(bp) >= 0) {
+    check_run((slab_t *)bp);
+  }
+}
+
+//
+// check_run - Check that slab run's free count agrees with its bitmap
+//
+static void check_run(slab_t *run)
+{
+  int w, nfree = 0;
+
+  for (w = 0; w < SLAB_MAPWORDS; w++) {
+    nfree += __builtin_popcountll(run->freemap[w]);
+  }
+  if (run->nfree != nfree) {
+    report("Error: slab run %p counts %d free slots, bitmap has %d\n",
+           run, run->nfree, nfree);
   }
 }
 
-static void printblock(void *bp) 
+static void printblock(void *bp)
 {
-  uint32_t hsize, halloc, fsize, falloc;
+  uint32_t hsize, halloc, hprev, fsize, falloc;
 
   hsize = GET_SIZE(HDRP(bp));
-  halloc = GET_ALLOC(HDRP(bp));  
-  fsize = GET_SIZE(FTRP(bp));
-  falloc = GET_ALLOC(FTRP(bp));  
-    
+  halloc = GET_ALLOC(HDRP(bp));
+  hprev = GET_PREV_ALLOC(HDRP(bp));
+
   if (hsize == 0) {
     printf("%p: EOL\n", bp);
     return;
   }
 
-  printf("%p: header: [%d:%c] footer: [%d:%c]\n",
-	 bp, 
-	 (int) hsize, (halloc ? 'a' : 'f'), 
-	 (int) fsize, (falloc ? 'a' : 'f')); 
+  // allocated blocks have no footer to show
+  if (halloc) {
+    printf("%p: header: [%d:%c%c]\n",
+	   bp,
+	   (int) hsize, (hprev ? 'a' : 'f'), 'a');
+    return;
+  }
+
+  fsize = GET_SIZE(FTRP(bp));
+  falloc = GET_ALLOC(FTRP(bp));
+  printf("%p: header: [%d:%c%c] footer: [%d:%c]\n",
+	 bp,
+	 (int) hsize, (hprev ? 'a' : 'f'), 'f',
+	 (int) fsize, (falloc ? 'a' : 'f'));
 }
 
-static void checkblock(void *bp) 
+static void checkblock(void *bp)
 {
-  if ((uintptr_t)bp % 8) {
-    printf("Error: %p is not doubleword aligned\n", bp);
+  if ((uintptr_t)bp % ALIGNMENT) {
+    report("Error: %p is not aligned to %d bytes\n", bp, ALIGNMENT);
   }
-  if (GET(HDRP(bp)) != GET(FTRP(bp))) {
-    printf("Error: header does not match footer\n");
+  if (!GET_ALLOC(HDRP(bp)) &&
+      (GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp)) || GET_ALLOC(FTRP(bp)))) {
+    report("Error: %p header does not match footer\n", bp);
   }
 }
-
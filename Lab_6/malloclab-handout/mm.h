@@ -2,9 +2,101 @@
 #include <stdint.h>
 
 extern int mm_init (void);
-extern void *mm_malloc (uint32_t size);
+extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
-extern void *mm_realloc(void *ptr, uint32_t size);
+extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+
+/*
+ * Heap consistency checks; both print each error and return how many
+ * they found. mm_checkrecent only checks the blocks changed since the
+ * last check of either kind.
+ */
+extern int mm_checkheap(int verbose);
+extern int mm_checkrecent(int verbose);
+
+/*
+ * Allocator events and heap snapshots for the fragmentation timeline.
+ * Only built when config.h sets MM_EVENTS.
+ */
+enum {
+    MM_EV_SPLIT,        /* a block was split, the remainder freed */
+    MM_EV_COALESCE1,    /* coalesce cases of Figure 9.40: neither neighbor free */
+    MM_EV_COALESCE2,    /*   next block free */
+    MM_EV_COALESCE3,    /*   previous block free */
+    MM_EV_COALESCE4,    /*   both free */
+    MM_EV_EXTEND,       /* the heap grew, or an arena started a segment */
+    MM_EV_TRIM,         /* the heap shrank */
+    MM_EV_SEARCH,       /* find_fit ran */
+    MM_NUM_EVENTS
+};
+
+typedef struct {
+    unsigned long count[MM_NUM_EVENTS]; /* occurrences of each event */
+    unsigned long extend_bytes;         /* bytes added by MM_EV_EXTEND */
+    unsigned long trim_bytes;           /* bytes given back by MM_EV_TRIM */
+    unsigned long search_steps;         /* free blocks examined by MM_EV_SEARCH */
+    unsigned long search_max;           /* most examined by one search */
+} mm_events_t;
+
+typedef struct {
+    unsigned long heap_bytes;   /* current heap size */
+    unsigned long free_bytes;   /* bytes in free blocks */
+    unsigned long free_blocks;  /* blocks on the free lists */
+    unsigned long largest_free; /* biggest of them */
+} mm_heapstat_t;
+
+extern void mm_events(mm_events_t *ev);
+extern void mm_heapstat(mm_heapstat_t *hs);
+
+/*
+ * Placement policies for find_fit; mm_set_fit takes effect at the next
+ * mm_init. A probe is one free block examined by a search.
+ */
+enum {
+    MM_FIT_FIRST,       /* first block that fits, smallest usable bin first */
+    MM_FIT_NEXT,        /* first fit, resuming where the last search stopped */
+    MM_FIT_BEST,        /* smallest block that fits */
+    MM_FIT_GOOD,        /* best fit, but stop at one within 1/8 of the request */
+    MM_FIT_SEG,         /* segregated fit: first fit in small bins, bounded best fit in large (default) */
+    MM_NUM_FITS
+};
+
+#define MM_PROBE_BUCKETS 16 /* probe histogram: 0, then [2^(k-1), 2^k) */
+
+typedef struct {
+    unsigned long searches;                /* calls to find_fit */
+    unsigned long probes;                  /* blocks examined by all of them */
+    unsigned long max;                     /* most examined by one search */
+    unsigned long hist[MM_PROBE_BUCKETS];  /* searches by probe count */
+} mm_fitstats_t;
+
+extern void mm_set_fit(int policy);
+
+/*
+ * Deferred coalescing: freed small blocks wait on per-size quick lists
+ * and are coalesced in batches. Off by default; mm_set_defer takes
+ * effect at the next mm_init.
+ */
+extern void mm_set_defer(int on);
+
+/*
+ * Cache line placement. mm_set_lines keeps every payload of up to
+ * MM_CACHE_LINE bytes within one line, from the next mm_init on;
+ * mm_malloc_flags asks for one block to be placed that way
+ * (MM_LINE_NOCROSS) or on lines no other payload shares
+ * (MM_LINE_EXCLUSIVE).
+ */
+#define MM_CACHE_LINE 64
+
+enum {
+    MM_LINE_NOCROSS   = 1, /* span no more lines than the size needs */
+    MM_LINE_EXCLUSIVE = 2  /* start on a line, share no line with another payload */
+};
+
+extern void mm_set_lines(int on);
+extern void *mm_malloc_flags(size_t size, int flags);
+extern void mm_fitstats(mm_fitstats_t *fs);
 
 
 /* 
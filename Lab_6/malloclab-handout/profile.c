@@ -0,0 +1,376 @@
+/*
+ * profile.c - Allocation profiles of traces for mdriver -P
+ *
+ * Each trace is replayed on paper: a table of the live size and birth
+ * of every block id is all it takes to count request sizes, lifetimes
+ * (in requests between the malloc and the free), realloc growth and
+ * the peak number of live blocks of every size.
+ *
+ * The suggested slab classes trade two kinds of waste. A request
+ * rounded up to its class's slot wastes the difference, and every
+ * class keeps a partly used run around, on average half of PROF_RUN
+ * bytes per trace. choose_classes picks the class boundaries that
+ * minimize the sum over the peak live blocks of small sizes, by
+ * dynamic programming over the ALIGNMENT multiples.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+#define GROUPS (PROF_SMALL / ALIGNMENT)  /* slot sizes ALIGNMENT, 2*ALIGNMENT, ... PROF_SMALL */
+
+/* Shades of the heatmap cells, from none to all of a row's requests */
+static const char shades[] = " .:-=+*#%@";
+
+/* Realloc new/old size ratios, the upper bounds of the growth buckets */
+static const char *growth_names[PROF_GROWTH] = {
+    "< 1/2", "< 1", "= 1", "< 5/4", "< 3/2", "< 2", "< 4", ">= 4"
+};
+
+/* Live blocks of one trace while it is replayed */
+typedef struct {
+    unsigned long live[PROF_SMALL + 1], peak[PROF_SMALL + 1];
+    unsigned long big_live[PROF_COLS], big_peak[PROF_COLS];
+    unsigned long group_live[GROUPS + 1], group_peak[GROUPS + 1];
+} live_t;
+
+/* The slab classes suggested for a profile */
+typedef struct {
+    int n;                        /* number of classes */
+    int slot[PROF_CLASSES];       /* slot size of each, ascending */
+    int warmup;                   /* SLAB_WARMUP */
+    double waste;                 /* rounding waste of the peak live blocks, bytes */
+    double uniform;               /*   and with one class per ALIGNMENT bytes */
+    double live;                  /* peak live bytes of the sizes the classes cover */
+} classes_t;
+
+/*
+ * size_bucket - Heatmap column of a request of size bytes: the
+ *     smallest k with size <= 2^k
+ */
+static int size_bucket(int size)
+{
+    int k = size <= 1 ? 0 : 64 - __builtin_clzll((unsigned long long)size - 1);
+
+    return k < PROF_COLS ? k : PROF_COLS - 1;
+}
+
+/*
+ * life_bucket - Heatmap column of a lifetime of d >= 1 requests: the
+ *     k with 2^k <= d < 2^(k+1)
+ */
+static int life_bucket(int d)
+{
+    int k = 63 - __builtin_clzll((unsigned long long)d);
+
+    return k < PROF_COLS ? k : PROF_COLS - 1;
+}
+
+/*
+ * growth_bucket - Growth bucket of a realloc from oldsize to newsize
+ */
+static int growth_bucket(int oldsize, int newsize)
+{
+    double r = oldsize > 0 ? (double)newsize / oldsize : 4.0;
+
+    if (r < 0.5)  return 0;
+    if (r < 1.0)  return 1;
+    if (r == 1.0) return 2;
+    if (r < 1.25) return 3;
+    if (r < 1.5)  return 4;
+    if (r < 2.0)  return 5;
+    if (r < 4.0)  return 6;
+    return 7;
+}
+
+/*
+ * count_live - Count one more (delta 1) or one less (delta -1) live
+ *     block of size bytes and keep the peaks up to date
+ */
+static void count_live(live_t *l, int size, int delta)
+{
+    int g;
+
+    if (size > PROF_SMALL) {
+	g = size_bucket(size);
+	l->big_live[g] += delta;
+	if (l->big_live[g] > l->big_peak[g])
+	    l->big_peak[g] = l->big_live[g];
+	return;
+    }
+    l->live[size] += delta;
+    if (l->live[size] > l->peak[size])
+	l->peak[size] = l->live[size];
+    g = (size + ALIGNMENT - 1) / ALIGNMENT;
+    l->group_live[g] += delta;
+    if (l->group_live[g] > l->group_peak[g])
+	l->group_peak[g] = l->group_live[g];
+}
+
+/*
+ * profile_init - Start an empty profile
+ */
+void profile_init(profile_t *p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+/*
+ * profile_trace - Add a trace's requests to the profile
+ */
+void profile_trace(profile_t *p, const char *name, const traceop_t *ops,
+		   int num_ops, int num_ids)
+{
+    prof_row_t *row;
+    live_t *l;
+    int *size, *birth;
+    int i, id;
+
+    p->rows = realloc(p->rows, (p->ntraces + 1) * sizeof(prof_row_t));
+    size = malloc(num_ids * sizeof(int));
+    birth = malloc(num_ids * sizeof(int));
+    l = calloc(1, sizeof(live_t));
+    if (p->rows == NULL || size == NULL || birth == NULL || l == NULL) {
+	fprintf(stderr, "profile_trace: out of memory\n");
+	exit(1);
+    }
+    row = &p->rows[p->ntraces++];
+    memset(row, 0, sizeof(*row));
+    row->name = name;
+    for (id = 0; id < num_ids; id++)
+	size[id] = -1;
+
+    for (i = 0; i < num_ops; i++) {
+	id = ops[i].index;
+	switch (ops[i].type) {
+	case ALLOC:
+	    row->requests++;
+	    row->size[size_bucket(ops[i].size)]++;
+	    size[id] = ops[i].size;
+	    birth[id] = i;
+	    count_live(l, size[id], 1);
+	    break;
+	case REALLOC:
+	    row->requests++;
+	    row->size[size_bucket(ops[i].size)]++;
+	    if (size[id] < 0) {
+		birth[id] = i;
+	    }
+	    else {
+		p->growth[growth_bucket(size[id], ops[i].size)]++;
+		count_live(l, size[id], -1);
+	    }
+	    size[id] = ops[i].size;
+	    count_live(l, size[id], 1);
+	    break;
+	case FREE:
+	    if (size[id] < 0)
+		break;
+	    row->frees++;
+	    row->life[life_bucket(i - birth[id])]++;
+	    count_live(l, size[id], -1);
+	    size[id] = -1;
+	    break;
+	}
+    }
+
+    /* blocks the trace never frees */
+    for (id = 0; id < num_ids; id++)
+	if (size[id] >= 0)
+	    row->life[PROF_COLS]++;
+
+    for (i = 0; i <= PROF_SMALL; i++)
+	p->peak[i] += l->peak[i];
+    for (i = 0; i < PROF_COLS; i++)
+	p->big_peak[i] += l->big_peak[i];
+    for (i = 0; i <= GROUPS; i++)
+	if (l->group_peak[i] > p->group_peak[i])
+	    p->group_peak[i] = l->group_peak[i];
+    free(size);
+    free(birth);
+    free(l);
+}
+
+/*
+ * choose_classes - Suggest slab classes for the profile
+ *
+ * Slabs pay off for a size whose live blocks fill at least half a run
+ * in some trace; the largest such size is SLAB_MAX. SLAB_WARMUP is the
+ * number of blocks that half fills a run of SLAB_MAX byte slots. Below
+ * SLAB_MAX, cost[k][j] is the least waste of k classes covering the
+ * sizes up to j*ALIGNMENT, and the number of classes is the one that
+ * minimizes the waste plus half a run per class and trace.
+ */
+static void choose_classes(profile_t *p, classes_t *c)
+{
+    static double cost[PROF_CLASSES + 1][GROUPS + 1];
+    static int from[PROF_CLASSES + 1][GROUPS + 1];
+    double w[GROUPS + 1], wr[GROUPS + 1];  /* peak blocks and their bytes, up to g*ALIGNMENT */
+    double waste, best;
+    int g, m, i, j, k, r, kmax;
+
+    m = 1;
+    for (g = 1; g <= GROUPS; g++)
+	if (p->group_peak[g] >= (unsigned long)(PROF_RUN / (g * ALIGNMENT) / 2))
+	    m = g;
+    c->warmup = PROF_RUN / (m * ALIGNMENT) / 2;
+
+    /* prefix sums, so the waste of one class is two subtractions */
+    w[0] = wr[0] = 0;
+    for (g = 1; g <= m; g++) {
+	w[g] = w[g - 1] + (g == 1 ? p->peak[0] : 0);
+	wr[g] = wr[g - 1];
+	for (r = (g - 1) * ALIGNMENT + 1; r <= g * ALIGNMENT; r++) {
+	    w[g] += p->peak[r];
+	    wr[g] += (double)p->peak[r] * r;
+	}
+    }
+    c->live = wr[m];
+
+    /* waste of one class of j*ALIGNMENT byte slots for the sizes above i*ALIGNMENT */
+#define WASTE(i, j) ((double)(j) * ALIGNMENT * (w[j] - w[i]) - (wr[j] - wr[i]))
+
+    kmax = m < PROF_CLASSES ? m : PROF_CLASSES;
+    for (j = 0; j <= m; j++)
+	cost[0][j] = j == 0 ? 0 : -1;
+    for (k = 1; k <= kmax; k++) {
+	for (j = 0; j <= m; j++) {
+	    cost[k][j] = -1;
+	    for (i = k - 1; i < j; i++) {
+		if (cost[k - 1][i] < 0)
+		    continue;
+		waste = cost[k - 1][i] + WASTE(i, j);
+		if (cost[k][j] < 0 || waste < cost[k][j]) {
+		    cost[k][j] = waste;
+		    from[k][j] = i;
+		}
+	    }
+	}
+    }
+
+    c->n = 1;
+    best = cost[1][m] + (double)PROF_RUN / 2 * p->ntraces;
+    for (k = 2; k <= kmax; k++) {
+	if (cost[k][m] + (double)k * PROF_RUN / 2 * p->ntraces < best) {
+	    best = cost[k][m] + (double)k * PROF_RUN / 2 * p->ntraces;
+	    c->n = k;
+	}
+    }
+    c->waste = cost[c->n][m];
+    c->uniform = 0;
+    for (g = 1; g <= m; g++)
+	c->uniform += WASTE(g - 1, g);
+#undef WASTE
+
+    for (k = c->n, j = m; k > 0; j = from[k][j], k--)
+	c->slot[k - 1] = j * ALIGNMENT;
+}
+
+/*
+ * print_heatmap - Print one row of shades per trace, a cell's shade
+ *     giving its share of the row's total
+ */
+static void print_heatmap(profile_t *p, FILE *fp, int life)
+{
+    unsigned long *cells, total;
+    int i, k, ncols = life ? PROF_COLS + 1 : PROF_COLS;
+
+    fprintf(fp, "%-6s%10s ", "trace", life ? "blocks" : "requests");
+    for (k = 0; k < PROF_COLS; k++)
+	fprintf(fp, "%3d", k);
+    fprintf(fp, life ? "  end\n" : "\n");
+    for (i = 0; i < p->ntraces; i++) {
+	cells = life ? p->rows[i].life : p->rows[i].size;
+	total = 0;
+	for (k = 0; k < ncols; k++)
+	    total += cells[k];
+	fprintf(fp, "%-6d%10lu ", i, total);
+	for (k = 0; k < ncols; k++)
+	    fprintf(fp, "%*c", k == PROF_COLS ? 5 : 3,
+		    cells[k] == 0 ? ' ' :
+		    shades[1 + (int)((sizeof(shades) - 3) * (double)cells[k] / total)]);
+	fprintf(fp, "   %s\n", p->rows[i].name);
+    }
+}
+
+/*
+ * profile_print - Print the heatmaps, growth ratios, peaks and the
+ *     suggested classes
+ */
+void profile_print(profile_t *p, FILE *fp)
+{
+    classes_t c;
+    unsigned long n, total = 0;
+    int g, k, r, lo;
+
+    fprintf(fp, "\nRequest sizes by trace, column k counts sizes up to 2^k"
+	    " (shades \"%s\" from none to all):\n", shades);
+    print_heatmap(p, fp, 0);
+
+    fprintf(fp, "\nLifetimes in requests by trace, column k counts [2^k, 2^(k+1)),"
+	    " end is never freed:\n");
+    print_heatmap(p, fp, 1);
+
+    for (k = 0; k < PROF_GROWTH; k++)
+	total += p->growth[k];
+    fprintf(fp, "\nRealloc new/old size ratios (%lu reallocs):\n", total);
+    for (k = 0; k < PROF_GROWTH && total > 0; k++)
+	fprintf(fp, "  %-6s %10lu  %5.1f%%\n", growth_names[k], p->growth[k],
+		100.0 * p->growth[k] / total);
+
+    fprintf(fp, "\nPeak live blocks by size, over all traces and in the worst one:\n");
+    fprintf(fp, "%17s %10s %10s\n", "sizes", "all", "worst");
+    for (g = 1; g <= GROUPS; g++) {
+	n = 0;
+	for (r = (g - 1) * ALIGNMENT + 1; r <= g * ALIGNMENT; r++)
+	    n += p->peak[r];
+	if (g == 1)
+	    n += p->peak[0];
+	if (n > 0)
+	    fprintf(fp, "%7d - %7d %10lu %10lu\n", (g - 1) * ALIGNMENT + 1, g * ALIGNMENT,
+		    n, p->group_peak[g]);
+    }
+    for (k = size_bucket(PROF_SMALL + 1); k < PROF_COLS; k++) {
+	if (p->big_peak[k] == 0)
+	    continue;
+	if (k == PROF_COLS - 1)
+	    fprintf(fp, "%7d - %7s %10lu\n", (1 << (k - 1)) + 1, "", p->big_peak[k]);
+	else
+	    fprintf(fp, "%7d - %7d %10lu\n", (1 << (k - 1)) + 1, 1 << k, p->big_peak[k]);
+    }
+
+    choose_classes(p, &c);
+    fprintf(fp, "\nSuggested slab classes: SLAB_MAX %d, SLAB_WARMUP %d\n",
+	    c.slot[c.n - 1], c.warmup);
+    fprintf(fp, "%6s %6s %17s\n", "class", "slot", "sizes");
+    for (k = 0, lo = 1; k < c.n; lo = c.slot[k++] + 1)
+	fprintf(fp, "%6d %6d %7d - %7d\n", k, c.slot[k], lo, c.slot[k]);
+    fprintf(fp, "Rounding wastes %.1f%% of %.0f peak live bytes; one class per"
+	    " ALIGNMENT bytes (%d) would waste %.1f%%.\n",
+	    c.live > 0 ? 100 * c.waste / c.live : 0, c.live,
+	    c.slot[c.n - 1] / ALIGNMENT, c.live > 0 ? 100 * c.uniform / c.live : 0);
+}
+
+/*
+ * profile_header - Write the suggested classes as a header mm.c can
+ *     include: SLAB_MAX, SLAB_WARMUP and the slot sizes as an X macro
+ */
+void profile_header(profile_t *p, FILE *fp)
+{
+    classes_t c;
+    int i;
+
+    choose_classes(p, &c);
+    fprintf(fp, "/*\n * Slab size classes suggested by mdriver -P for\n");
+    for (i = 0; i < p->ntraces; i++)
+	fprintf(fp, " *     %s\n", p->rows[i].name);
+    fprintf(fp, " * with ALIGNMENT %d. Slot sizes are multiples of ALIGNMENT in\n"
+	    " * ascending order; the last one is SLAB_MAX.\n */\n", ALIGNMENT);
+    fprintf(fp, "#define CLASS_ALIGNMENT %d\n", ALIGNMENT);
+    fprintf(fp, "#define CLASS_WARMUP    %d\n", c.warmup);
+    fprintf(fp, "#define SIZE_CLASSES(X) \\\n   ");
+    for (i = 0; i < c.n; i++)
+	fprintf(fp, " X(%d)", c.slot[i]);
+    fprintf(fp, "\n");
+}
@@ -0,0 +1,48 @@
+/*
+ * profile.h - prototypes for the trace profiles of mdriver -P in profile.c
+ *
+ * A profile is computed from the requests alone, without running any
+ * allocator: request sizes and block lifetimes by power of two per
+ * trace, realloc growth ratios, and the peak number of live blocks of
+ * every small size. From those it suggests slab size classes.
+ */
+#include <stdio.h>
+#include "trace.h"
+#include "config.h"
+
+#define PROF_COLS    24   /* power-of-two buckets per heatmap row */
+#define PROF_SMALL   256  /* largest request size profiled byte by byte */
+#define PROF_RUN     4096 /* bytes of one slab run, as SLAB_RUN in mm.c */
+#define PROF_CLASSES 32   /* most slab classes to suggest */
+#define PROF_GROWTH  8    /* buckets of realloc new/old size ratios */
+
+/* One heatmap row per trace */
+typedef struct {
+    const char *name;
+    unsigned long requests;             /* mallocs and reallocs */
+    unsigned long frees;
+    unsigned long size[PROF_COLS];      /* requests by size, bucket k holds (2^(k-1), 2^k] */
+    unsigned long life[PROF_COLS + 1];  /* frees by lifetime in requests, [2^k, 2^(k+1)); last: never freed */
+} prof_row_t;
+
+typedef struct {
+    int ntraces;
+    prof_row_t *rows;
+    unsigned long growth[PROF_GROWTH];  /* reallocs by new/old size ratio */
+    unsigned long peak[PROF_SMALL + 1]; /* peak live blocks of each small size, summed over traces */
+    unsigned long big_peak[PROF_COLS];  /*   and of larger sizes, by power of two */
+    unsigned long group_peak[PROF_SMALL / ALIGNMENT + 1]; /* largest peak of any one trace, by size/ALIGNMENT */
+} profile_t;
+
+/* Start an empty profile */
+void profile_init(profile_t *p);
+
+/* Add a trace's requests to the profile */
+void profile_trace(profile_t *p, const char *name, const traceop_t *ops,
+		   int num_ops, int num_ids);
+
+/* Print the heatmaps, growth ratios, peaks and the suggested classes */
+void profile_print(profile_t *p, FILE *fp);
+
+/* Write the suggested classes as a header mm.c can include */
+void profile_header(profile_t *p, FILE *fp);
@@ -0,0 +1,99 @@
+/*
+ * rep2bin.c - Convert a text .rep trace into the binary trace format
+ *     of trace.h, which mdriver maps and replays without parsing
+ *
+ * usage: rep2bin <in.rep> <out.bin>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024 /* max string size */
+
+static void die(const char *msg, const char *path)
+{
+    fprintf(stderr, "rep2bin: %s %s: %s\n", msg, path, strerror(errno));
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    bintrace_hdr_t hdr;
+    traceop_t *ops;
+    char type[MAXLINE];
+    int index, size;
+    int max_index = -1;
+    int n = 0;
+
+    if (argc != 3) {
+	fprintf(stderr, "usage: %s <in.rep> <out.bin>\n", argv[0]);
+	exit(1);
+    }
+    if ((in = fopen(argv[1], "r")) == NULL)
+	die("could not open", argv[1]);
+
+    /* The text header: heap size, ids, ops, weight */
+    memset(&hdr, 0, sizeof(hdr));
+    strncpy(hdr.magic, BINTRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = BINTRACE_VERSION;
+    if (fscanf(in, "%d %d %d %d", &hdr.sugg_heapsize, &hdr.num_ids,
+	       &hdr.num_ops, &hdr.weight) != 4) {
+	fprintf(stderr, "rep2bin: %s: bad trace header\n", argv[1]);
+	exit(1);
+    }
+    if ((ops = (traceop_t *)calloc(hdr.num_ops, sizeof(traceop_t))) == NULL)
+	die("out of memory for", argv[1]);
+
+    /* One request per line, exactly as read_trace in mdriver.c reads it */
+    while (fscanf(in, "%s", type) != EOF) {
+	if (n == hdr.num_ops) {
+	    fprintf(stderr, "rep2bin: %s: more than %d ops\n", argv[1], hdr.num_ops);
+	    exit(1);
+	}
+	size = 0;
+	switch (type[0]) {
+	case 'a':
+	case 'r':
+	    if (fscanf(in, "%d %d", &index, &size) != 2) {
+		fprintf(stderr, "rep2bin: %s: bad request at op %d\n", argv[1], n);
+		exit(1);
+	    }
+	    ops[n].type = (type[0] == 'a') ? ALLOC : REALLOC;
+	    break;
+	case 'f':
+	    if (fscanf(in, "%d", &index) != 1) {
+		fprintf(stderr, "rep2bin: %s: bad request at op %d\n", argv[1], n);
+		exit(1);
+	    }
+	    ops[n].type = FREE;
+	    break;
+	default:
+	    fprintf(stderr, "rep2bin: %s: bogus type character (%c)\n", argv[1], type[0]);
+	    exit(1);
+	}
+	ops[n].index = index;
+	ops[n].size = size;
+	if (index > max_index)
+	    max_index = index;
+	n++;
+    }
+    fclose(in);
+    if (n != hdr.num_ops || max_index != hdr.num_ids - 1) {
+	fprintf(stderr, "rep2bin: %s: header says %d ops and %d ids, found %d and %d\n",
+		argv[1], hdr.num_ops, hdr.num_ids, n, max_index + 1);
+	exit(1);
+    }
+
+    if ((out = fopen(argv[2], "wb")) == NULL)
+	die("could not create", argv[2]);
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1 ||
+	fwrite(ops, sizeof(traceop_t), n, out) != (size_t)n ||
+	fclose(out) != 0)
+	die("could not write", argv[2]);
+    free(ops);
+    return 0;
+}
@@ -0,0 +1,25 @@
+/*
+ * size_classes.h - default slab size classes of mm.c
+ *
+ * One class per ALIGNMENT bytes of slot up to 64 bytes. mkclasses turns
+ * a spec like this one into the lookup tables of class_table.h; to use
+ * another, e.g. the one "mdriver -P" suggests for a set of traces:
+ *
+ *     unix> make clean; make CLASS_SPEC=my_classes.h
+ *
+ * A spec defines CLASS_ALIGNMENT, the ALIGNMENT it was made for,
+ * CLASS_WARMUP, the live blocks of a size before it moves to slabs,
+ * and SIZE_CLASSES(X), the slot sizes in ascending order.
+ */
+#define CLASS_ALIGNMENT ALIGNMENT
+#define CLASS_WARMUP    32
+
+#if ALIGNMENT == 8
+#define SIZE_CLASSES(X) X(8) X(16) X(24) X(32) X(40) X(48) X(56) X(64)
+#elif ALIGNMENT == 16
+#define SIZE_CLASSES(X) X(16) X(32) X(48) X(64)
+#elif ALIGNMENT == 32
+#define SIZE_CLASSES(X) X(32) X(64)
+#else
+#define SIZE_CLASSES(X) X(64)
+#endif
@@ -0,0 +1,43 @@
+/*
+ * trace.h - Trace requests and the binary trace file format shared by
+ *     mdriver and rep2bin
+ *
+ * A binary trace is a bintrace_hdr_t followed directly by num_ops
+ * traceop_t records in host byte order. mdriver maps the file and
+ * uses the records in place as trace->ops, so there is nothing to
+ * parse and nothing to copy.
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdint.h>
+
+/* Characterizes a single trace operation (allocator request) */
+typedef enum {ALLOC, FREE, REALLOC} RequestType;
+#define NUM_REQUEST_TYPES 3
+typedef struct {
+    RequestType type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* First bytes of every binary trace file */
+#define BINTRACE_MAGIC   "MMTRACE"
+#define BINTRACE_VERSION 1
+
+/* Header of a binary trace file; the ops follow it directly */
+typedef struct {
+    char magic[8];         /* BINTRACE_MAGIC, NUL padded */
+    uint32_t version;      /* BINTRACE_VERSION */
+    int32_t sugg_heapsize; /* the four numbers of a .rep header */
+    int32_t num_ids;
+    int32_t num_ops;
+    int32_t weight;
+    uint32_t reserved;     /* zero; keeps the ops 8-byte aligned */
+} bintrace_hdr_t;
+
+/* The records are used in place, so their layout is part of the format */
+typedef char bintrace_op_size_check[sizeof(traceop_t) == 12 ? 1 : -1];
+typedef char bintrace_hdr_size_check[sizeof(bintrace_hdr_t) == 32 ? 1 : -1];
+
+#endif /* __TRACE_H_ */